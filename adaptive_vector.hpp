@@ -0,0 +1,330 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <decartian.hpp>
+
+// Sequence that lives either in a std::vector or in an AdvancedVector and moves between them
+// depending on the recent operation mix. Every kWindow operations the counted reads and edits are
+// priced for both layouts: a read costs 1 in the vector and ~log n in the treap, a middle edit
+// (insert, erase, cut, concatenation) costs ~n / kShiftSpeed in the vector and ~log n in the treap.
+// The layout changes only when the other one would have been kSwitchFactor times cheaper and the
+// saving pays for the O(n) conversion, so a mixed workload does not bounce between the two.
+// Both operator[] overloads count reads, the const one through a relaxed atomic increment, so
+// concurrent readers of a const AdaptiveVector are safe and read-heavy phases are seen however the
+// elements are reached. The layout changes only in mutating members (push_back, insert, erase,
+// cut_subarray, +=) and in adapt(), never inside an element access, so references returned by
+// operator[] stay valid until the next mutation.
+template <typename T, class RandomGenerator = std::mt19937_64, class Storage = SharedNodeStorage>
+class AdaptiveVector {
+public:
+    using value_type = T;
+    using tree_type = AdvancedVector<T, RandomGenerator, Storage>;
+
+    static constexpr size_t kWindow = 256;
+    static constexpr double kShiftSpeed = 16.0;
+    static constexpr double kTreeStepCost = 4.0;
+    static constexpr double kSwitchFactor = 2.0;
+
+private:
+    std::vector<T> contiguous_;
+    tree_type tree_;
+    bool is_tree_ = false;
+
+    // Copyable wrapper, so the vector keeps its implicit copies and moves
+    class ReadCounter {
+    private:
+        std::atomic<size_t> count_{0};
+
+    public:
+        ReadCounter() = default;
+        ReadCounter(const ReadCounter& other) : count_(other.Load()) {}
+        ReadCounter& operator=(const ReadCounter& other) {
+            count_.store(other.Load(), std::memory_order_relaxed);
+            return *this;
+        }
+
+        void Increment() {
+            count_.fetch_add(1, std::memory_order_relaxed);
+        }
+        size_t Load() const {
+            return count_.load(std::memory_order_relaxed);
+        }
+        void Reset() {
+            count_.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    mutable ReadCounter reads_;
+    size_t edits_ = 0;
+
+    explicit AdaptiveVector(tree_type&& tree);
+
+    void count_read() const;
+    void count_edit();
+    // Reconsiders the layout once a window of operations has been counted
+    void tick();
+
+public:
+    AdaptiveVector() = default;
+    AdaptiveVector(std::initializer_list<T> list);
+    template <typename It, typename std::enable_if<
+            std::is_convertible<typename std::iterator_traits<It>::value_type, T >::value, int
+            >::type = 0>
+    AdaptiveVector(It first, It last);
+
+    size_t size() const;
+    bool empty() const;
+    void clear();
+
+    // Current layout, and explicit O(n) conversions for callers that know the coming phase
+    bool is_contiguous() const;
+    void make_contiguous();
+    void make_tree();
+    // Prices the operations counted since the last decision and switches the layout if the other
+    // one is cheaper; mutating members call it every kWindow operations
+    void adapt();
+
+    const T& operator[](unsigned index) const;
+    T& operator[](unsigned index);
+
+    void push_back(const T& value);
+    void insert(unsigned position, const T& value);
+    void erase(unsigned position);
+    void erase(unsigned position, unsigned length);
+
+    AdaptiveVector<T, RandomGenerator, Storage> cut_subarray(unsigned position, unsigned length);
+    AdaptiveVector<T, RandomGenerator, Storage>& operator+=(AdaptiveVector<T, RandomGenerator, Storage>&& rhs);
+
+    bool operator==(const AdaptiveVector<T, RandomGenerator, Storage>& other) const;
+
+    std::vector<T> to_vector() const;
+    template <typename OutputIt>
+    OutputIt copy_to(OutputIt destination) const;
+};
+
+template <typename T, class RandomGenerator, class Storage>
+AdaptiveVector<T, RandomGenerator, Storage>::AdaptiveVector(tree_type&& tree)
+        : contiguous_(), tree_(std::move(tree)), is_tree_(true) {
+}
+
+template <typename T, class RandomGenerator, class Storage>
+AdaptiveVector<T, RandomGenerator, Storage>::AdaptiveVector(std::initializer_list<T> list)
+        : contiguous_(list) {
+}
+
+template <typename T, class RandomGenerator, class Storage>
+template <typename It, typename std::enable_if<
+        std::is_convertible<typename std::iterator_traits<It>::value_type, T >::value, int
+        >::type>
+AdaptiveVector<T, RandomGenerator, Storage>::AdaptiveVector(It first, It last)
+        : contiguous_(first, last) {
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdaptiveVector<T, RandomGenerator, Storage>::count_read() const {
+    reads_.Increment();
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdaptiveVector<T, RandomGenerator, Storage>::count_edit() {
+    ++edits_;
+    tick();
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdaptiveVector<T, RandomGenerator, Storage>::tick() {
+    if (reads_.Load() + edits_ >= kWindow) {
+        adapt();
+    }
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdaptiveVector<T, RandomGenerator, Storage>::adapt() {
+    double n = size();
+    double tree_step = kTreeStepCost * std::log2(n + 2);
+    double reads = reads_.Load();
+    double vector_cost = reads + edits_ * n / kShiftSpeed;
+    double tree_cost = (reads + edits_) * tree_step;
+    reads_.Reset();
+    edits_ = 0;
+
+    if (!is_tree_ && vector_cost > kSwitchFactor * tree_cost + n) {
+        make_tree();
+    } else if (is_tree_ && tree_cost > kSwitchFactor * vector_cost + n) {
+        make_contiguous();
+    }
+}
+
+template <typename T, class RandomGenerator, class Storage>
+size_t AdaptiveVector<T, RandomGenerator, Storage>::size() const {
+    return is_tree_ ? tree_.size() : contiguous_.size();
+}
+
+template <typename T, class RandomGenerator, class Storage>
+bool AdaptiveVector<T, RandomGenerator, Storage>::empty() const {
+    return size() == 0;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdaptiveVector<T, RandomGenerator, Storage>::clear() {
+    contiguous_.clear();
+    tree_.clear();
+    is_tree_ = false;
+    reads_.Reset();
+    edits_ = 0;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+bool AdaptiveVector<T, RandomGenerator, Storage>::is_contiguous() const {
+    return !is_tree_;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdaptiveVector<T, RandomGenerator, Storage>::make_contiguous() {
+    if (is_tree_) {
+        contiguous_ = tree_.to_vector();
+        tree_.clear();
+        is_tree_ = false;
+    }
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdaptiveVector<T, RandomGenerator, Storage>::make_tree() {
+    if (!is_tree_) {
+        tree_ = tree_type(contiguous_.begin(), contiguous_.end());
+        std::vector<T>().swap(contiguous_);
+        is_tree_ = true;
+    }
+}
+
+template <typename T, class RandomGenerator, class Storage>
+const T& AdaptiveVector<T, RandomGenerator, Storage>::operator[](unsigned index) const {
+    count_read();
+    return is_tree_ ? tree_[index] : contiguous_[index];
+}
+
+template <typename T, class RandomGenerator, class Storage>
+T& AdaptiveVector<T, RandomGenerator, Storage>::operator[](unsigned index) {
+    count_read();
+    return is_tree_ ? tree_[index] : contiguous_[index];
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdaptiveVector<T, RandomGenerator, Storage>::push_back(const T& value) {
+    // appending is cheap in both layouts, it is priced like a read
+    count_read();
+    tick();
+    if (is_tree_) {
+        tree_.push_back(value);
+    } else {
+        contiguous_.push_back(value);
+    }
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdaptiveVector<T, RandomGenerator, Storage>::insert(unsigned position, const T& value) {
+    if (position > size()) {
+        throw std::range_error("AdaptiveVector: position is out of range");
+    }
+    if (position == size()) {
+        push_back(value);
+        return;
+    }
+    if (is_tree_) {
+        tree_.insert(position, value);
+    } else {
+        contiguous_.insert(contiguous_.begin() + position, value);
+    }
+    count_edit();
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdaptiveVector<T, RandomGenerator, Storage>::erase(unsigned position) {
+    if (position < size()) {
+        erase(position, 1);
+    }
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdaptiveVector<T, RandomGenerator, Storage>::erase(unsigned position, unsigned length) {
+    if (position >= size()) {
+        return;
+    }
+    if (is_tree_) {
+        tree_.erase(position, length);
+    } else {
+        size_t end = position + std::min<size_t>(length, contiguous_.size() - position);
+        contiguous_.erase(contiguous_.begin() + position, contiguous_.begin() + end);
+    }
+    count_edit();
+}
+
+template <typename T, class RandomGenerator, class Storage>
+AdaptiveVector<T, RandomGenerator, Storage>
+AdaptiveVector<T, RandomGenerator, Storage>::cut_subarray(unsigned position, unsigned length) {
+    if (position > size()) {
+        throw std::range_error("AdaptiveVector: position is out of range");
+    }
+    AdaptiveVector<T, RandomGenerator, Storage> result;
+    if (is_tree_) {
+        result = AdaptiveVector<T, RandomGenerator, Storage>(tree_.cut_subarray(position, length));
+    } else {
+        size_t end = position + std::min<size_t>(length, contiguous_.size() - position);
+        result.contiguous_.assign(std::make_move_iterator(contiguous_.begin() + position),
+                                  std::make_move_iterator(contiguous_.begin() + end));
+        contiguous_.erase(contiguous_.begin() + position, contiguous_.begin() + end);
+    }
+    count_edit();
+    return result;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+AdaptiveVector<T, RandomGenerator, Storage>&
+AdaptiveVector<T, RandomGenerator, Storage>::operator+=(AdaptiveVector<T, RandomGenerator, Storage>&& rhs) {
+    if (is_tree_) {
+        rhs.make_tree();
+        tree_ += std::move(rhs.tree_);
+    } else {
+        rhs.make_contiguous();
+        contiguous_.insert(contiguous_.end(), std::make_move_iterator(rhs.contiguous_.begin()),
+                           std::make_move_iterator(rhs.contiguous_.end()));
+    }
+    rhs.clear();
+    count_edit();
+    return *this;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+bool AdaptiveVector<T, RandomGenerator, Storage>::operator==(
+        const AdaptiveVector<T, RandomGenerator, Storage>& other) const {
+    return size() == other.size() && to_vector() == other.to_vector();
+}
+
+template <typename T, class RandomGenerator, class Storage>
+std::vector<T> AdaptiveVector<T, RandomGenerator, Storage>::to_vector() const {
+    return is_tree_ ? tree_.to_vector() : contiguous_;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+template <typename OutputIt>
+OutputIt AdaptiveVector<T, RandomGenerator, Storage>::copy_to(OutputIt destination) const {
+    if (is_tree_) {
+        return tree_.copy_to(destination);
+    }
+    return std::copy(contiguous_.begin(), contiguous_.end(), destination);
+}
+
+template <typename T, class RandomGenerator, class Storage>
+std::ostream&
+operator<<(std::ostream& output_stream, const AdaptiveVector<T, RandomGenerator, Storage>& data) {
+    data.copy_to(std::ostream_iterator<T>(output_stream, " "));
+    return output_stream;
+}
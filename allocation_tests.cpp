@@ -0,0 +1,205 @@
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <random>
+#include <vector>
+
+#include <decartian.hpp>
+#include <static_advanced_vector.hpp>
+
+#include <gtest/gtest.h>
+
+// Separate binary: it replaces the global operator new, so every heap allocation of the process is
+// counted, and checks allocation budgets and comparison counts that a regression (an accidental
+// DeepCopy, a linear scan) would break.
+
+namespace {
+    size_t n_allocations = 0;
+
+    void* CountedAllocate(size_t size) {
+        ++n_allocations;
+        if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+            return pointer;
+        }
+        throw std::bad_alloc();
+    }
+
+    void* CountedAllocate(size_t size, std::align_val_t alignment) {
+        ++n_allocations;
+        size_t align = static_cast<size_t>(alignment);
+        if (void* pointer = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+            return pointer;
+        }
+        throw std::bad_alloc();
+    }
+}
+
+void* operator new(size_t size) { return CountedAllocate(size); }
+void* operator new[](size_t size) { return CountedAllocate(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return CountedAllocate(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return CountedAllocate(size, alignment); }
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { std::free(pointer); }
+
+namespace Test {
+
+    // Number of heap allocations made by action
+    template <typename Action>
+    size_t CountAllocations(Action action) {
+        size_t before = n_allocations;
+        action();
+        return n_allocations - before;
+    }
+
+    template <typename Vector>
+    Vector MakeVector(size_t size) {
+        std::vector<int> values(size);
+        for (size_t i = 0; i < size; ++i) {
+            values[i] = static_cast<int>(i);
+        }
+        return Vector(values.begin(), values.end());
+    }
+
+    template <typename Vector>
+    class AllocationBudget : public testing::Test {};
+
+    using Storages = testing::Types<AdvancedVector<int>, AdvancedVector<int, std::mt19937_64, UniqueNodeStorage>>;
+    TYPED_TEST_SUITE(AllocationBudget, Storages);
+
+    TYPED_TEST(AllocationBudget, SingleElementOperations) {
+        auto a = MakeVector<TypeParam>(10000);
+        auto sorted = MakeVector<TypeParam>(10000);
+        const auto& const_sorted = sorted;
+        std::mt19937 gen(43);
+        for (int step = 0; step < 1000; ++step) {
+            unsigned position = gen() % (a.size() + 1);
+            EXPECT_EQ(CountAllocations([&]() { a.push_back(step); }), 1u);
+            EXPECT_EQ(CountAllocations([&]() { a.push_front(step); }), 1u);
+            EXPECT_EQ(CountAllocations([&]() { a.insert(position, step); }), 1u);
+            EXPECT_EQ(CountAllocations([&]() { a.erase(gen() % a.size()); }), 0u);
+            EXPECT_EQ(CountAllocations([&]() { a[gen() % a.size()] = step; }), 0u);
+
+            int value = static_cast<int>(gen() % 10000);
+            EXPECT_EQ(CountAllocations([&]() { sorted.insert_sorted(value); }), 1u);
+            EXPECT_EQ(CountAllocations([&]() { EXPECT_GT(const_sorted.upper_bound(value), 0u); }), 0u);
+        }
+    }
+
+    TYPED_TEST(AllocationBudget, SubarraysMoveNodes) {
+        auto a = MakeVector<TypeParam>(10000);
+        auto b = MakeVector<TypeParam>(3000);
+
+        EXPECT_EQ(CountAllocations([&]() { a.insert(5000, std::move(b)); }), 0u);
+        EXPECT_EQ(a.size(), 13000u);
+
+        TypeParam piece;
+        EXPECT_EQ(CountAllocations([&]() { piece = a.cut_subarray(1000, 4000); }), 0u);
+        EXPECT_EQ(CountAllocations([&]() { a += std::move(piece); }), 0u);
+
+        auto sorted = MakeVector<TypeParam>(5000);
+        EXPECT_EQ(CountAllocations([&]() { piece = sorted.split_by_value(2500); }), 0u);
+        EXPECT_EQ(CountAllocations([&]() { sorted.merge_sorted(std::move(piece)); }), 0u);
+        EXPECT_EQ(sorted.size(), 5000u);
+
+        // copies allocate exactly one node per element
+        EXPECT_EQ(CountAllocations([&]() { piece = a.copy_subarray(100, 2500); }), 2500u);
+        EXPECT_EQ(CountAllocations([&]() { a.insert(0, piece); }), 2500u);
+        EXPECT_EQ(CountAllocations([&]() { a += piece; }), 2500u);
+        EXPECT_EQ(a.size(), 13000u + 2 * 2500u);
+    }
+
+    TEST(AllocationBudget, HandlesAndRelayout) {
+        auto a = MakeVector<AdvancedVector<int>>(10000);
+        AdvancedVector<int>::handle_t handle;
+        EXPECT_EQ(CountAllocations([&]() { handle = a.insert(1234, -1); }), 1u);
+        EXPECT_EQ(CountAllocations([&]() { EXPECT_EQ(a.position(handle), 1234u); }), 0u);
+        EXPECT_EQ(CountAllocations([&]() { EXPECT_TRUE(a.precedes(a.handle_at(10), handle)); }), 0u);
+
+        // one block for all nodes, the rest are scratch arrays of the layout pass and the teardown
+        // stack of the old tree, which grow geometrically
+        for (auto layout : {NodeLayout::kPreorder, NodeLayout::kVanEmdeBoas}) {
+            size_t relayout_allocations = CountAllocations([&]() { a.relayout(layout); });
+            EXPECT_LT(relayout_allocations, 64u);
+        }
+    }
+
+    TEST(AllocationBudget, StaticVectorNeverAllocates) {
+        StaticAdvancedVector<int, 4096> a, b;
+        EXPECT_EQ(CountAllocations([&]() {
+            for (int i = 0; i < 3000; ++i) {
+                a.push_back(i);
+                b.insert(b.size() / 2, i);
+            }
+            EXPECT_FALSE(a == b);
+            b = a;
+            EXPECT_TRUE(a == b);
+            b.erase(100, 1000);
+            a.erase(100, 1000);
+            EXPECT_TRUE(a == b);
+        }), 0u);
+    }
+
+    // Average number of comparisons per operation over queries on sorted vectors of growing size,
+    // divided by log2(size). An O(log n) descent keeps the ratio bounded, a linear scan makes it grow.
+    TEST(Complexity, SortedDescentsAreLogarithmic) {
+        std::vector<double> ratios;
+        for (size_t size : {1u << 10, 1u << 13, 1u << 16, 1u << 19}) {
+            auto a = MakeVector<AdvancedVector<int, std::mt19937_64, UniqueNodeStorage>>(size);
+            size_t comparisons = 0;
+            auto counting_less = [&comparisons](int lhs, int rhs) {
+                ++comparisons;
+                return lhs < rhs;
+            };
+
+            std::mt19937 gen(47);
+            const size_t queries = 2000;
+            for (size_t query = 0; query < queries; ++query) {
+                int value = static_cast<int>(gen() % size);
+                EXPECT_EQ(a.lower_bound(value, counting_less), size_t(value));
+                a.insert_sorted(value, counting_less);
+                a.erase(a.upper_bound(value, counting_less) - 1);
+            }
+            double per_operation = double(comparisons) / (3 * queries);
+            ratios.push_back(per_operation / std::log2(double(size)));
+        }
+        for (double ratio : ratios) {
+            // a treap of random priorities has expected depth about 1.39 log2(n)
+            EXPECT_LT(ratio, 3.0);
+        }
+        EXPECT_LT(ratios.back(), ratios.front() * 1.5);
+    }
+
+    TEST(Complexity, MergeSortedIsSublinearForSmallInputs) {
+        using Vector = AdvancedVector<int, std::mt19937_64, UniqueNodeStorage>;
+        size_t comparisons = 0;
+        auto counting_less = [&comparisons](int lhs, int rhs) {
+            ++comparisons;
+            return lhs < rhs;
+        };
+        const size_t size = 1 << 16;
+        const size_t small = 16;
+        // built once, every round merges into a copy; copying calls no comparator
+        auto base = MakeVector<Vector>(size);
+        for (int round = 0; round < 20; ++round) {
+            auto a = base.copy_subarray(0, size);
+            std::vector<int> values;
+            std::mt19937 gen(53 + round);
+            for (size_t i = 0; i < small; ++i) {
+                values.push_back(static_cast<int>(gen() % size));
+            }
+            std::sort(values.begin(), values.end());
+            a.merge_sorted(Vector(values.begin(), values.end()), counting_less);
+            EXPECT_EQ(a.size(), size + small);
+        }
+        // O(m log(n / m)) with m = 16: a few hundred comparisons, far below n
+        double per_merge = double(comparisons) / 20;
+        EXPECT_LT(per_merge, 4.0 * small * std::log2(double(size) / small + 1));
+    }
+}
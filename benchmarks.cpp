@@ -0,0 +1,267 @@
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include <decartian.hpp>
+#include <headers/fenwick_tree.hpp>
+#include <headers/blocked_fenwick_tree.hpp>
+#include <headers/huge_page_allocator.hpp>
+#include <headers/segment_tree.hpp>
+#include <headers/cartesian_tree.hpp>
+
+// Usage: Benchmarks [suite] [size] [operations]
+// Cache and TLB misses are read from perf counters when the kernel allows it.
+
+namespace Bench {
+
+    class PerfCounter {
+    private:
+        int fd_;
+
+    public:
+        PerfCounter(uint32_t type, uint64_t config) : fd_(-1) {
+#ifdef __linux__
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd_ = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+        }
+
+        PerfCounter(const PerfCounter&) = delete;
+        PerfCounter& operator=(const PerfCounter&) = delete;
+
+        ~PerfCounter() {
+#ifdef __linux__
+            if (fd_ >= 0) {
+                close(fd_);
+            }
+#endif
+        }
+
+        bool Available() const {
+            return fd_ >= 0;
+        }
+
+        void Start() {
+#ifdef __linux__
+            if (fd_ >= 0) {
+                ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+        }
+
+        uint64_t Stop() {
+            uint64_t value = 0;
+#ifdef __linux__
+            if (fd_ >= 0) {
+                ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+                if (read(fd_, &value, sizeof(value)) != sizeof(value)) {
+                    value = 0;
+                }
+            }
+#endif
+            return value;
+        }
+    };
+
+    class Measurement {
+    private:
+        std::chrono::steady_clock::time_point start_;
+#ifdef __linux__
+        PerfCounter cache_misses_{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES};
+        PerfCounter tlb_misses_{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+#else
+        PerfCounter cache_misses_{0, 0};
+        PerfCounter tlb_misses_{0, 0};
+#endif
+
+    public:
+        void Start() {
+            cache_misses_.Start();
+            tlb_misses_.Start();
+            start_ = std::chrono::steady_clock::now();
+        }
+
+        void Stop(const std::string& name, size_t operations) {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            uint64_t cache_misses = cache_misses_.Stop();
+            uint64_t tlb_misses = tlb_misses_.Stop();
+
+            double nanoseconds = std::chrono::duration<double, std::nano>(elapsed).count();
+            std::cout << std::left << std::setw(40) << name << std::right << std::fixed
+                      << std::setprecision(1) << std::setw(10) << nanoseconds / operations << " ns/op";
+            if (cache_misses_.Available()) {
+                std::cout << std::setw(10) << double(cache_misses) / operations << " LLC misses/op";
+            }
+            if (tlb_misses_.Available()) {
+                std::cout << std::setw(10) << double(tlb_misses) / operations << " dTLB misses/op";
+            }
+            std::cout << std::endl;
+        }
+    };
+
+    template <typename Tree>
+    void FenwickOperations(const std::string& name, size_t size, size_t operations) {
+        Tree tree(size);
+        std::mt19937_64 gen(42);
+        std::vector<int> indices(operations);
+        for (auto& index : indices) {
+            index = gen() % size;
+        }
+
+        Measurement measurement;
+        measurement.Start();
+        for (int index : indices) {
+            tree.inc(index, 1);
+        }
+        measurement.Stop(name + " inc", operations);
+
+        long long checksum = 0;
+        measurement.Start();
+        for (int index : indices) {
+            checksum += tree.sum(0, index);
+        }
+        measurement.Stop(name + " sum", operations);
+
+        if (checksum < 0) {
+            std::cout << checksum << std::endl;
+        }
+    }
+
+    void Fenwick(size_t size, size_t operations) {
+        std::cout << "Fenwick trees of " << size << " elements, " << operations << " random operations"
+                  << std::endl;
+        FenwickOperations<FenwickTree<long long>>("FenwickTree", size, operations);
+        FenwickOperations<FenwickTree<long long, FenwickSum<long long>, HugePageAllocator<long long>>>(
+                "FenwickTree + huge pages", size, operations);
+        FenwickOperations<BlockedFenwickTree<long long>>("BlockedFenwickTree", size, operations);
+        FenwickOperations<BlockedFenwickTree<long long, FenwickSum<long long>, HugePageAllocator<long long>>>(
+                "BlockedFenwickTree + huge pages", size, operations);
+    }
+
+    void TreapReads(const std::string& name, const AdvancedVector<int>& vector, const std::vector<unsigned>& indices) {
+        long long checksum = 0;
+        Measurement measurement;
+        measurement.Start();
+        for (unsigned index : indices) {
+            checksum += vector[index];
+        }
+        measurement.Stop(name, indices.size());
+
+        if (checksum < 0) {
+            std::cout << checksum << std::endl;
+        }
+    }
+
+    void Treap(size_t size, size_t operations) {
+        std::cout << "AdvancedVector of " << size << " elements built by random inserts, " << operations
+                  << " random reads" << std::endl;
+        std::mt19937_64 gen(42);
+        // nodes are allocated in insertion order, so neighbours in the tree are far apart in memory
+        AdvancedVector<int> vector;
+        for (size_t i = 0; i < size; ++i) {
+            vector.insert(gen() % (vector.size() + 1), static_cast<int>(i));
+        }
+        std::vector<unsigned> indices(operations);
+        for (auto& index : indices) {
+            index = gen() % size;
+        }
+
+        TreapReads("scattered nodes", vector, indices);
+
+        Measurement measurement;
+        measurement.Start();
+        vector.relayout(NodeLayout::kPreorder);
+        measurement.Stop("relayout in preorder", size);
+        TreapReads("preorder layout", vector, indices);
+
+        measurement.Start();
+        vector.relayout(NodeLayout::kVanEmdeBoas);
+        measurement.Stop("relayout in van Emde Boas order", size);
+        TreapReads("van Emde Boas layout", vector, indices);
+    }
+
+    template <typename Tree>
+    void RangeMinimumQueries(const std::string& name, Tree& tree, const std::vector<std::pair<size_t, size_t>>& ranges) {
+        long long checksum = 0;
+        Measurement measurement;
+        measurement.Start();
+        for (const auto& range : ranges) {
+            checksum += tree.query(range.first, range.second);
+        }
+        measurement.Stop(name, ranges.size());
+
+        if (checksum < 0) {
+            std::cout << checksum << std::endl;
+        }
+    }
+
+    void RangeMinimum(size_t size, size_t operations) {
+        std::cout << "Range minimum over " << size << " elements, " << operations << " random queries" << std::endl;
+        std::mt19937_64 gen(42);
+        std::vector<int> values(size);
+        for (auto& value : values) {
+            value = static_cast<int>(gen() % 1000000);
+        }
+        std::vector<std::pair<size_t, size_t>> ranges(operations);
+        for (auto& range : ranges) {
+            range = {gen() % size, gen() % size};
+        }
+
+        Measurement measurement;
+        measurement.Start();
+        CartesianTree<int> cartesian(values);
+        measurement.Stop("CartesianTree build", size);
+        RangeMinimumQueries("CartesianTree query", cartesian, ranges);
+
+        measurement.Start();
+        SegmentTree<int, FenwickMin<int>> segment(values);
+        measurement.Stop("SegmentTree build", size);
+        RangeMinimumQueries("SegmentTree query", segment, ranges);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string suite = argc > 1 ? argv[1] : "all";
+
+    if (suite == "fenwick" || suite == "all") {
+        size_t size = argc > 2 ? std::stoull(argv[2]) : 100000000;
+        size_t operations = argc > 3 ? std::stoull(argv[3]) : 1000000;
+        Bench::Fenwick(size, operations);
+    }
+
+    if (suite == "treap" || suite == "all") {
+        size_t size = argc > 2 ? std::stoull(argv[2]) : 10000000;
+        size_t operations = argc > 3 ? std::stoull(argv[3]) : 1000000;
+        Bench::Treap(size, operations);
+    }
+
+    if (suite == "rmq" || suite == "all") {
+        size_t size = argc > 2 ? std::stoull(argv[2]) : 10000000;
+        size_t operations = argc > 3 ? std::stoull(argv[3]) : 1000000;
+        Bench::RangeMinimum(size, operations);
+    }
+
+    return 0;
+}
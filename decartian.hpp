@@ -1,3 +1,5 @@
+#pragma once
+
 #include <iostream>
 #include <memory>
 #include <cmath>
@@ -11,52 +13,108 @@
 #include <type_traits>
 #include <exception>
 #include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <functional>
+#include <thread>
 
 #include <nodes.hpp>
+#include <unique_nodes.hpp>
+#include <reclamation.hpp>
+
+// Header of the binary format written by AdvancedVector::save. Values and priorities are stored
+// as two flat arrays in order, both aligned to 64 bytes, so a mapped file can be read in place.
+struct AdvancedVectorFlatHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t value_size;
+    uint64_t size;
+    uint64_t values_offset;
+    uint64_t priorities_offset;
+    uint64_t total_size;
+};
 
-template <typename T, class RandomGenerator = std::mt19937_64>
+template <typename T, class RandomGenerator = std::mt19937_64, class Storage = SharedNodeStorage>
 class AdvancedVector {
+public:
+    // Root pointer type of the storage policy: SharedNodeStorage (nodes.hpp) keeps parent links
+    // and supports iterators, UniqueNodeStorage (unique_nodes.hpp) is smaller and faster
+    using node_pointer = typename Storage::template pointer<T, uint64_t>;
+
 private:
-    nodeptr_t<T, uint64_t> storage_;
+    node_pointer storage_;
     RandomGenerator gen;
 
-    explicit AdvancedVector(nodeptr_t<T, uint64_t> node);
+    // In-order copy of the values made by compact(), dropped by every non-const member
+    std::vector<T> contiguous_;
+    bool is_compacted_ = false;
+
+    bool deferred_reclamation_ = false;
+
+    explicit AdvancedVector(node_pointer node);
+
+    void invalidate_contiguous();
+    // Drops a detached subtree: destroys it here, or hands it to the DeferredReclaimer
+    void retire(node_pointer node);
+
+    // Below this many elements per thread sort does not start threads
+    static constexpr size_t kParallelSortGrain = 1 << 16;
+
+    template <typename Compare>
+    static void sort_values(std::vector<T>& values, Compare comp);
 
 public:
     using value_type = T;
 
     class iterator;
+    class const_span;
+    class handle_t;
+
+    // With SharedNodeStorage single element insertions return a handle to the new element
+    using insert_result = typename std::conditional<Storage::kHasParentLinks, handle_t, void>::type;
 
     AdvancedVector() = default;
-    AdvancedVector(const AdvancedVector<T, RandomGenerator>& other);
-    AdvancedVector(AdvancedVector<T, RandomGenerator>&& other) noexcept;
-    AdvancedVector<T, RandomGenerator>& operator=(const AdvancedVector<T, RandomGenerator>& other);
-    AdvancedVector<T, RandomGenerator>& operator=(AdvancedVector<T, RandomGenerator>&& other) noexcept;
-    AdvancedVector<T, RandomGenerator>& operator=(const std::initializer_list<T>& data);
-    AdvancedVector<T, RandomGenerator>& operator=(std::initializer_list<T>&& data) noexcept;
+    AdvancedVector(const AdvancedVector<T, RandomGenerator, Storage>& other);
+    AdvancedVector(AdvancedVector<T, RandomGenerator, Storage>&& other) noexcept;
+    AdvancedVector<T, RandomGenerator, Storage>& operator=(const AdvancedVector<T, RandomGenerator, Storage>& other);
+    AdvancedVector<T, RandomGenerator, Storage>& operator=(AdvancedVector<T, RandomGenerator, Storage>&& other) noexcept;
+    AdvancedVector<T, RandomGenerator, Storage>& operator=(const std::initializer_list<T>& data);
+    AdvancedVector<T, RandomGenerator, Storage>& operator=(std::initializer_list<T>&& data) noexcept;
     AdvancedVector(std::initializer_list<T> list);
+    ~AdvancedVector();
 
     template <typename ... Tail>
-    explicit AdvancedVector(AdvancedVector<T, RandomGenerator>&& head, Tail ... tail);
+    explicit AdvancedVector(AdvancedVector<T, RandomGenerator, Storage>&& head, Tail ... tail);
     template <typename ... Tail>
-    explicit AdvancedVector(const AdvancedVector<T, RandomGenerator>& head, Tail ... tail);
+    explicit AdvancedVector(const AdvancedVector<T, RandomGenerator, Storage>& head, Tail ... tail);
 
+    // O(n), the treap is linked in one pass instead of n insertions
     template <typename It, typename std::enable_if<
             std::is_convertible<typename std::iterator_traits<It>::value_type, T >::value, int
             >::type = 0>
     AdvancedVector(It first, It last);
 
-    bool operator==(const AdvancedVector<T>& other) const;
+    template <class OtherGenerator, class OtherStorage>
+    bool operator==(const AdvancedVector<T, OtherGenerator, OtherStorage>& other) const;
 
     size_t size() const;
     bool empty() const;
     void clear();
 
+    // With deferred reclamation every member that drops a tree or a range (clear, erase of a range,
+    // assignment, load, *=, relayout, destruction) passes the dropped nodes to a background thread
+    // (reclamation.hpp) instead of freeing them, so clear and erase return in O(log n). Otherwise they are destroyed in place, iteratively. Copy and move construction take the
+    // setting of the source, assignment keeps the setting of the destination. Handles stay safe
+    // to use while the worker tears a dropped subtree down: they report its elements as erased.
+    void set_deferred_reclamation(bool enabled);
+    bool deferred_reclamation() const;
+
     const T& operator[](unsigned index) const;
     T& operator[](unsigned index);
 
-    void push_back(const T& value);
-    void push_front(const T& value);
+    insert_result push_back(const T& value);
+    insert_result push_front(const T& value);
 
     T& front();
     const T& front() const;
@@ -65,28 +123,127 @@ public:
 
     void erase(unsigned position);
     void erase(unsigned position, unsigned length);
-    void insert(unsigned position, const T& value);
-    void insert(unsigned position, const AdvancedVector<T, RandomGenerator>& data);
-    void insert(unsigned position, AdvancedVector<T, RandomGenerator>&& data);
+    insert_result insert(unsigned position, const T& value);
+    void insert(unsigned position, const AdvancedVector<T, RandomGenerator, Storage>& data);
+    void insert(unsigned position, AdvancedVector<T, RandomGenerator, Storage>&& data);
 
 //    void insert(iterator pos, const T& value);
-//    void insert(iterator pos, const AdvancedVector<T, RandomGenerator>& data);
-//    void insert(iterator pos, AdvancedVector<T, RandomGenerator>&& data);
+//    void insert(iterator pos, const AdvancedVector<T, RandomGenerator, Storage>& data);
+//    void insert(iterator pos, AdvancedVector<T, RandomGenerator, Storage>&& data);
+
+    AdvancedVector<T, RandomGenerator, Storage> cut_subarray(unsigned position, unsigned length);
+    AdvancedVector<T, RandomGenerator, Storage> copy_subarray(unsigned position, unsigned length);
 
-    AdvancedVector<T, RandomGenerator> cut_subarray(unsigned position, unsigned length);
-    AdvancedVector<T, RandomGenerator> copy_subarray(unsigned position, unsigned length);
+    // Splits at sorted positions in one descent and leaves this vector empty. Returns
+    // cuts.size() + 1 pieces, piece i holds the elements from cuts[i - 1] up to cuts[i].
+    std::vector<AdvancedVector<T, RandomGenerator, Storage>> split_at(const std::vector<size_t>& cuts);
+    // Joins pieces in order by rounds of pairwise merges, O(k log n) for k pieces
+    static AdvancedVector<T, RandomGenerator, Storage>
+    concat(std::vector<AdvancedVector<T, RandomGenerator, Storage>>&& pieces);
 
+    // Iterators need parent links, so they are available only with SharedNodeStorage
     iterator begin() const;
     iterator end() const;
 
-    AdvancedVector<T, RandomGenerator>& operator+=(const AdvancedVector<T, RandomGenerator>& rhs);
-    AdvancedVector<T, RandomGenerator>& operator+=(AdvancedVector<T, RandomGenerator>&& rhs);
+    // Handles follow their element through inserts, erases, splits and merges, they need parent
+    // links as well. position climbs from the element to the root, precedes climbs from both to
+    // their lowest common ancestor, both O(log n). They throw std::invalid_argument for a handle
+    // of an erased element or of an element of another vector. relayout invalidates handles.
+    // A handle is bound to a node, not to a value: sort moves the values between the nodes, so
+    // afterwards a handle keeps its position and refers to whatever value was sorted into it.
+    handle_t handle_at(unsigned position) const;
+    size_t position(const handle_t& handle) const;
+    bool precedes(const handle_t& first, const handle_t& second) const;
+
+    AdvancedVector<T, RandomGenerator, Storage>& operator+=(const AdvancedVector<T, RandomGenerator, Storage>& rhs);
+    AdvancedVector<T, RandomGenerator, Storage>& operator+=(AdvancedVector<T, RandomGenerator, Storage>&& rhs);
+
+    AdvancedVector<T, RandomGenerator, Storage> operator+(const AdvancedVector<T, RandomGenerator, Storage>& rhs);
+    AdvancedVector<T, RandomGenerator, Storage> operator+(AdvancedVector<T, RandomGenerator, Storage>&& rhs);
+
+    AdvancedVector<T, RandomGenerator, Storage>& operator*=(size_t multiplier);
+    AdvancedVector<T, RandomGenerator, Storage> operator*(size_t multiplier);
+
+    // Binary snapshot of values and priorities, loading rebuilds the same tree in O(n).
+    // Only for trivially copyable T.
+    void save(std::ostream& output_stream) const;
+    void load(std::istream& input_stream);
+    void load(const void* data, size_t size);
+
+    // Values of a snapshot placed in memory (e.g. a mapped file) without copying
+    static std::pair<const T*, size_t> flat_values(const void* data, size_t size);
+
+    // In-order copy of all values, O(n)
+    std::vector<T> to_vector() const;
+    template <typename OutputIt>
+    OutputIt copy_to(OutputIt destination) const;
+
+    // Lays the values out in one contiguous buffer, O(n). Until the next call of a non-const
+    // member (including non-const operator[], front and back) as_span returns views into it.
+    void compact();
+    bool is_compacted() const;
+    const_span as_span(unsigned position, unsigned length) const;
+
+    // Moves all nodes into one contiguous block in the given order with the same tree shape, so
+    // descents after heavy churn stop missing the cache on every level. The values move to the new
+    // nodes, which invalidates iterators. Only with SharedNodeStorage, see Relayout in nodes.hpp.
+    void relayout(NodeLayout layout = NodeLayout::kVanEmdeBoas);
+
+    // Sorts the values in place: they are moved out, sorted (by several threads for large n) and
+    // moved back into the same nodes, so the tree shape, priorities and iterators stay, O(n log n).
+    // Iterators and handles keep their positions, not their values.
+    template <typename Compare = std::less<T>>
+    void sort(Compare comp = Compare());
+    // Merges another vector sorted by comp into this sorted one, O(m log(n / m + 1)) for sizes
+    // m <= n. Equal elements of this vector come first. The source is left empty.
+    template <typename Compare = std::less<T>>
+    void merge_sorted(AdvancedVector<T, RandomGenerator, Storage>&& other, Compare comp = Compare());
+    template <typename Compare = std::less<T>>
+    void merge_sorted(const AdvancedVector<T, RandomGenerator, Storage>& other, Compare comp = Compare());
+
+    // Sorted mode: for a vector kept sorted by comp, each of these is one O(log n) descent by value
+    // that counts positions with the subtree sizes. lower_bound and upper_bound return positions.
+    template <typename Compare = std::less<T>>
+    size_t lower_bound(const T& value, Compare comp = Compare()) const;
+    template <typename Compare = std::less<T>>
+    size_t upper_bound(const T& value, Compare comp = Compare()) const;
+    // Inserts after the elements equal to value and returns the position of the new element
+    template <typename Compare = std::less<T>>
+    size_t insert_sorted(const T& value, Compare comp = Compare());
+    // Cuts off and returns the elements not less than value, the smaller ones stay here
+    template <typename Compare = std::less<T>>
+    AdvancedVector<T, RandomGenerator, Storage> split_by_value(const T& value, Compare comp = Compare());
+
+    class const_span {
+    private:
+        const T* data_;
+        size_t size_;
+
+    public:
+        const_span(const T* data, size_t size) : data_(data), size_(size) {}
+
+        const T* data() const { return data_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        const T* begin() const { return data_; }
+        const T* end() const { return data_ + size_; }
+        const T& operator[](size_t index) const { return data_[index]; }
+    };
+
+    class handle_t {
+    private:
+        weak_nodeptr_t<T, uint64_t> node_;
 
-    AdvancedVector<T, RandomGenerator> operator+(const AdvancedVector<T, RandomGenerator>& rhs);
-    AdvancedVector<T, RandomGenerator> operator+(AdvancedVector<T, RandomGenerator>&& rhs);
+        friend class AdvancedVector<T, RandomGenerator, Storage>;
 
-    AdvancedVector<T, RandomGenerator>& operator*=(size_t multiplier);
-    AdvancedVector<T, RandomGenerator> operator*(size_t multiplier);
+        explicit handle_t(const nodeptr_t<T, uint64_t>& node) : node_(node) {}
+
+    public:
+        handle_t() = default;
+
+        // true once the element has been erased
+        bool expired() const { return node_.expired(); }
+    };
 
     class iterator : public std::iterator<std::bidirectional_iterator_tag, T> {
     private:
@@ -121,32 +278,32 @@ public:
     };
 };
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 bool
-AdvancedVector<T, RandomGenerator>::iterator::operator==(
-        const AdvancedVector<T, RandomGenerator>::iterator& other) const {
+AdvancedVector<T, RandomGenerator, Storage>::iterator::operator==(
+        const AdvancedVector<T, RandomGenerator, Storage>::iterator& other) const {
     return iterator_node_ == other.iterator_node_ && root_ == other.root_;
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 bool
-AdvancedVector<T, RandomGenerator>::iterator::operator!=(
-        const AdvancedVector<T, RandomGenerator>::iterator& other) const {
+AdvancedVector<T, RandomGenerator, Storage>::iterator::operator!=(
+        const AdvancedVector<T, RandomGenerator, Storage>::iterator& other) const {
     return iterator_node_ != other.iterator_node_ || root_ != other.root_;
 }
 
-template <typename T, class RandomGenerator>
-typename AdvancedVector<T, RandomGenerator>::iterator&
-AdvancedVector<T, RandomGenerator>::iterator::operator++() {
+template <typename T, class RandomGenerator, class Storage>
+typename AdvancedVector<T, RandomGenerator, Storage>::iterator&
+AdvancedVector<T, RandomGenerator, Storage>::iterator::operator++() {
     if (iterator_node_ != nullptr) {
         iterator_node_ = GetNext(iterator_node_);
     }
     return *this;
 }
 
-template <typename T, class RandomGenerator>
-const typename AdvancedVector<T, RandomGenerator>::iterator
-AdvancedVector<T, RandomGenerator>::iterator::operator++(int) {
+template <typename T, class RandomGenerator, class Storage>
+const typename AdvancedVector<T, RandomGenerator, Storage>::iterator
+AdvancedVector<T, RandomGenerator, Storage>::iterator::operator++(int) {
     auto result = *this;
     if (iterator_node_ != nullptr) {
         iterator_node_ = GetNext(iterator_node_);
@@ -154,9 +311,9 @@ AdvancedVector<T, RandomGenerator>::iterator::operator++(int) {
     return result;
 }
 
-template <typename T, class RandomGenerator>
-typename AdvancedVector<T, RandomGenerator>::iterator&
-AdvancedVector<T, RandomGenerator>::iterator::operator--() {
+template <typename T, class RandomGenerator, class Storage>
+typename AdvancedVector<T, RandomGenerator, Storage>::iterator&
+AdvancedVector<T, RandomGenerator, Storage>::iterator::operator--() {
     if (iterator_node_ != nullptr) {
         iterator_node_ = GetPrev(iterator_node_);
     } else {
@@ -165,9 +322,9 @@ AdvancedVector<T, RandomGenerator>::iterator::operator--() {
     return *this;
 }
 
-template <typename T, class RandomGenerator>
-const typename AdvancedVector<T, RandomGenerator>::iterator
-AdvancedVector<T, RandomGenerator>::iterator::operator--(int) {
+template <typename T, class RandomGenerator, class Storage>
+const typename AdvancedVector<T, RandomGenerator, Storage>::iterator
+AdvancedVector<T, RandomGenerator, Storage>::iterator::operator--(int) {
     auto result = *this;
     if (iterator_node_ != nullptr) {
         iterator_node_ = GetPrev(iterator_node_);
@@ -177,21 +334,21 @@ AdvancedVector<T, RandomGenerator>::iterator::operator--(int) {
     return result;
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 const T&
-AdvancedVector<T, RandomGenerator>::iterator::operator*() const {
+AdvancedVector<T, RandomGenerator, Storage>::iterator::operator*() const {
     return iterator_node_->GetValue();
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 T
-const *AdvancedVector<T, RandomGenerator>::iterator::operator->() const {
+const *AdvancedVector<T, RandomGenerator, Storage>::iterator::operator->() const {
     return &(iterator_node_->GetValue());
 }
 
-template <typename T, class RandomGenerator>
-typename AdvancedVector<T, RandomGenerator>::iterator
-AdvancedVector<T, RandomGenerator>::iterator::operator+(size_t offset) const {
+template <typename T, class RandomGenerator, class Storage>
+typename AdvancedVector<T, RandomGenerator, Storage>::iterator
+AdvancedVector<T, RandomGenerator, Storage>::iterator::operator+(size_t offset) const {
     if (offset < 10) {
         iterator result(*this);
         for (size_t i = 0; i < offset; ++i) {
@@ -203,9 +360,9 @@ AdvancedVector<T, RandomGenerator>::iterator::operator+(size_t offset) const {
     return iterator(GetByIndex(*root_, position + offset), root_);
 }
 
-template <typename T, class RandomGenerator>
-typename AdvancedVector<T, RandomGenerator>::iterator
-AdvancedVector<T, RandomGenerator>::iterator::operator-(size_t offset) const {
+template <typename T, class RandomGenerator, class Storage>
+typename AdvancedVector<T, RandomGenerator, Storage>::iterator
+AdvancedVector<T, RandomGenerator, Storage>::iterator::operator-(size_t offset) const {
     if (offset < 10) {
         iterator result(*this);
         for (size_t i = 0; i < offset; ++i) {
@@ -217,8 +374,8 @@ AdvancedVector<T, RandomGenerator>::iterator::operator-(size_t offset) const {
     return iterator(GetByIndex(*root_, position - offset), root_);
 }
 
-template <typename T, class RandomGenerator>
-std::ptrdiff_t AdvancedVector<T, RandomGenerator>::iterator::GetPosition() const {
+template <typename T, class RandomGenerator, class Storage>
+std::ptrdiff_t AdvancedVector<T, RandomGenerator, Storage>::iterator::GetPosition() const {
     if (*root_ == nullptr) {
         return 0;
     } else if (iterator_node_ == nullptr) {
@@ -228,293 +385,739 @@ std::ptrdiff_t AdvancedVector<T, RandomGenerator>::iterator::GetPosition() const
     }
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 std::ptrdiff_t
-AdvancedVector<T, RandomGenerator>::iterator::operator-(const typename AdvancedVector<T, RandomGenerator>::iterator& rhs) const {
+AdvancedVector<T, RandomGenerator, Storage>::iterator::operator-(const typename AdvancedVector<T, RandomGenerator, Storage>::iterator& rhs) const {
     return GetPosition() - rhs.GetPosition();
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>::AdvancedVector(const AdvancedVector<T, RandomGenerator>& other)
-        : storage_(DeepCopy(other.storage_)), gen() {
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>::AdvancedVector(const AdvancedVector<T, RandomGenerator, Storage>& other)
+        : storage_(DeepCopy(other.storage_)), gen(), deferred_reclamation_(other.deferred_reclamation_) {
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>::AdvancedVector(AdvancedVector<T, RandomGenerator>&& other) noexcept
-        : storage_(other.storage_), gen() {
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>::AdvancedVector(AdvancedVector<T, RandomGenerator, Storage>&& other) noexcept
+        : storage_(std::move(other.storage_)), gen(), deferred_reclamation_(other.deferred_reclamation_) {
+    other.invalidate_contiguous();
     other.storage_ = nullptr;
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>&
-AdvancedVector<T, RandomGenerator>::operator=(const AdvancedVector<T, RandomGenerator>& other) {
-    storage_ = DeepCopy(other.storage_);
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>::~AdvancedVector() {
+    retire(std::move(storage_));
+}
+
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>&
+AdvancedVector<T, RandomGenerator, Storage>::operator=(const AdvancedVector<T, RandomGenerator, Storage>& other) {
+    invalidate_contiguous();
+    auto copy = DeepCopy(other.storage_);
+    retire(std::move(storage_));
+    storage_ = std::move(copy);
     return *this;
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>&
-AdvancedVector<T, RandomGenerator>::operator=(AdvancedVector<T, RandomGenerator>&& other) noexcept {
-    storage_ = other.storage_;
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>&
+AdvancedVector<T, RandomGenerator, Storage>::operator=(AdvancedVector<T, RandomGenerator, Storage>&& other) noexcept {
+    invalidate_contiguous();
+    other.invalidate_contiguous();
+    retire(std::move(storage_));
+    storage_ = std::move(other.storage_);
     other.storage_ = nullptr;
     return *this;
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
+template <class OtherGenerator, class OtherStorage>
 bool
-AdvancedVector<T, RandomGenerator>::operator==(const AdvancedVector<T, std::mt19937_64>& other) const {
+AdvancedVector<T, RandomGenerator, Storage>::operator==(
+        const AdvancedVector<T, OtherGenerator, OtherStorage>& other) const {
     if (size() != other.size()) {
         return false;
     } else {
-        for (auto it = begin(), other_it = other.begin();
-                it != end() && other_it != other.end(); ++it, ++other_it) {
-            if (*it != *other_it) {
-                return false;
+        std::vector<T> other_values = other.to_vector();
+        bool equal = true;
+        size_t index = 0;
+        VisitInOrder(storage_, [&equal, &index, &other_values](const auto& node) {
+            if (equal && node.GetValue() != other_values[index]) {
+                equal = false;
             }
-        }
-        return true;
+            ++index;
+        });
+        return equal;
     }
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 size_t
-AdvancedVector<T, RandomGenerator>::size() const {
+AdvancedVector<T, RandomGenerator, Storage>::size() const {
     return (storage_ == nullptr) ? 0 : storage_->GetSubtreeSize();
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 bool
-AdvancedVector<T, RandomGenerator>::empty() const {
+AdvancedVector<T, RandomGenerator, Storage>::empty() const {
     return storage_ == nullptr;
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 const T&
-AdvancedVector<T, RandomGenerator>::operator[](unsigned index) const {
-    nodeptr_t<T, uint64_t> res = GetByIndex(storage_, index);
+AdvancedVector<T, RandomGenerator, Storage>::operator[](unsigned index) const {
+    auto res = GetByIndex(storage_, index);
     return res->GetValue();
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 T&
-AdvancedVector<T, RandomGenerator>::operator[](unsigned index) {
-    nodeptr_t<T, uint64_t> res = GetByIndex(storage_, index);
+AdvancedVector<T, RandomGenerator, Storage>::operator[](unsigned index) {
+    invalidate_contiguous();
+    auto res = GetByIndex(storage_, index);
     return res->GetValue();
 }
 
-template <typename T, class RandomGenerator>
-void
-AdvancedVector<T, RandomGenerator>::push_back(const T& value) {
-    storage_ = Insert(storage_, size(), value, gen());
+template <typename T, class RandomGenerator, class Storage>
+typename AdvancedVector<T, RandomGenerator, Storage>::insert_result
+AdvancedVector<T, RandomGenerator, Storage>::push_back(const T& value) {
+    return insert(size(), value);
 }
 
-template <typename T, class RandomGenerator>
-void
-AdvancedVector<T, RandomGenerator>::push_front(const T& value) {
-    storage_ = Insert(storage_, 0, value, gen());
+template <typename T, class RandomGenerator, class Storage>
+typename AdvancedVector<T, RandomGenerator, Storage>::insert_result
+AdvancedVector<T, RandomGenerator, Storage>::push_front(const T& value) {
+    return insert(0, value);
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 T&
-AdvancedVector<T, RandomGenerator>::front() {
+AdvancedVector<T, RandomGenerator, Storage>::front() {
+    invalidate_contiguous();
     return operator[](0);
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 const T&
-AdvancedVector<T, RandomGenerator>::front() const {
+AdvancedVector<T, RandomGenerator, Storage>::front() const {
     return operator[](0);
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 T&
-AdvancedVector<T, RandomGenerator>::back() {
+AdvancedVector<T, RandomGenerator, Storage>::back() {
+    invalidate_contiguous();
     return operator[](size() - 1);
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 void
-AdvancedVector<T, RandomGenerator>::erase(unsigned position) {
+AdvancedVector<T, RandomGenerator, Storage>::erase(unsigned position) {
+    invalidate_contiguous();
     if (position < size()) {
-        storage_ = Erase(storage_, position);
+        storage_ = Erase(std::move(storage_), position);
     }
 }
 
-template <typename T, class RandomGenerator>
-void
-AdvancedVector<T, RandomGenerator>::insert(unsigned position, const T& value) {
-    storage_ = Insert(storage_, position, value, gen());
+template <typename T, class RandomGenerator, class Storage>
+typename AdvancedVector<T, RandomGenerator, Storage>::insert_result
+AdvancedVector<T, RandomGenerator, Storage>::insert(unsigned position, const T& value) {
+    invalidate_contiguous();
+    if constexpr (Storage::kHasParentLinks) {
+        auto node = MakeNodePtrT<T, uint64_t>(value, gen());
+        storage_ = Insert(std::move(storage_), position, node);
+        return handle_t(node);
+    } else {
+        storage_ = Insert(std::move(storage_), position, value, gen());
+    }
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 void
-AdvancedVector<T, RandomGenerator>::insert(unsigned position, const AdvancedVector<T, RandomGenerator>& data) {
-    auto[split_first, split_second] = Split(storage_, position);
-    storage_ = Merge(split_first, DeepCopy(data.storage_), split_second);
+AdvancedVector<T, RandomGenerator, Storage>::insert(unsigned position, const AdvancedVector<T, RandomGenerator, Storage>& data) {
+    invalidate_contiguous();
+    auto[split_first, split_second] = Split(std::move(storage_), position);
+    storage_ = Merge(std::move(split_first), DeepCopy(data.storage_), std::move(split_second));
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 void
-AdvancedVector<T, RandomGenerator>::insert(unsigned position, AdvancedVector<T, RandomGenerator>&& data) {
-    auto[split_first, split_second] = Split(storage_, position);
-    storage_ = Merge(split_first, data.storage_, split_second);
+AdvancedVector<T, RandomGenerator, Storage>::insert(unsigned position, AdvancedVector<T, RandomGenerator, Storage>&& data) {
+    invalidate_contiguous();
+    data.invalidate_contiguous();
+    auto[split_first, split_second] = Split(std::move(storage_), position);
+    storage_ = Merge(std::move(split_first), std::move(data.storage_), std::move(split_second));
     data.storage_ = nullptr;
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>
-AdvancedVector<T, RandomGenerator>::cut_subarray(unsigned position, unsigned length) {
-    auto[head, subarray_storage, tail] = Split(storage_, position, length);
-    storage_ = Merge(head, tail);
-    return AdvancedVector<T, RandomGenerator>(subarray_storage);
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>
+AdvancedVector<T, RandomGenerator, Storage>::cut_subarray(unsigned position, unsigned length) {
+    invalidate_contiguous();
+    auto[head, subarray_storage, tail] = Split(std::move(storage_), position, length);
+    storage_ = Merge(std::move(head), std::move(tail));
+    return AdvancedVector<T, RandomGenerator, Storage>(std::move(subarray_storage));
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>
-AdvancedVector<T, RandomGenerator>::copy_subarray(unsigned position, unsigned length) {
-    auto[head, subarray_storage, tail] = Split(storage_, position, length);
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>
+AdvancedVector<T, RandomGenerator, Storage>::copy_subarray(unsigned position, unsigned length) {
+    auto[head, subarray_storage, tail] = Split(std::move(storage_), position, length);
     auto subarray_storage_copy = DeepCopy(subarray_storage);
-    storage_ = Merge(head, subarray_storage, tail);
-    return AdvancedVector<T, RandomGenerator>(subarray_storage_copy);
+    storage_ = Merge(std::move(head), std::move(subarray_storage), std::move(tail));
+    return AdvancedVector<T, RandomGenerator, Storage>(std::move(subarray_storage_copy));
+}
+
+template <typename T, class RandomGenerator, class Storage>
+std::vector<AdvancedVector<T, RandomGenerator, Storage>>
+AdvancedVector<T, RandomGenerator, Storage>::split_at(const std::vector<size_t>& cuts) {
+    if (!std::is_sorted(cuts.begin(), cuts.end()) || (!cuts.empty() && cuts.back() > size())) {
+        throw std::range_error("split_at: cuts must be sorted and not greater than size");
+    }
+    invalidate_contiguous();
+    std::vector<unsigned> positions(cuts.begin(), cuts.end());
+    auto pieces_storage = SplitMany(std::move(storage_), positions);
+    storage_ = nullptr;
+
+    std::vector<AdvancedVector<T, RandomGenerator, Storage>> pieces;
+    pieces.reserve(pieces_storage.size());
+    for (auto& piece : pieces_storage) {
+        pieces.push_back(AdvancedVector<T, RandomGenerator, Storage>(std::move(piece)));
+    }
+    return pieces;
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>::AdvancedVector(std::initializer_list<T> list) : storage_(nullptr) {
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>
+AdvancedVector<T, RandomGenerator, Storage>::concat(std::vector<AdvancedVector<T, RandomGenerator, Storage>>&& pieces) {
+    std::vector<node_pointer> pieces_storage;
+    pieces_storage.reserve(pieces.size());
+    for (auto& piece : pieces) {
+        piece.invalidate_contiguous();
+        pieces_storage.push_back(std::move(piece.storage_));
+        piece.storage_ = nullptr;
+    }
+    return AdvancedVector<T, RandomGenerator, Storage>(MergeMany(std::move(pieces_storage)));
+}
+
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>::AdvancedVector(std::initializer_list<T> list) : storage_(nullptr) {
     for (const auto& elem : list) {
         push_back(elem);
     }
 }
 
-template <typename T, class RandomGenerator>
-typename AdvancedVector<T, RandomGenerator>::iterator
-AdvancedVector<T, RandomGenerator>::begin() const {
+template <typename T, class RandomGenerator, class Storage>
+typename AdvancedVector<T, RandomGenerator, Storage>::iterator
+AdvancedVector<T, RandomGenerator, Storage>::begin() const {
+    static_assert(Storage::kHasParentLinks, "iterators require a storage with parent links");
     return iterator(GetLeft(storage_), &storage_);
 }
 
-template <typename T, class RandomGenerator>
-typename AdvancedVector<T, RandomGenerator>::iterator
-AdvancedVector<T, RandomGenerator>::end() const {
+template <typename T, class RandomGenerator, class Storage>
+typename AdvancedVector<T, RandomGenerator, Storage>::iterator
+AdvancedVector<T, RandomGenerator, Storage>::end() const {
+    static_assert(Storage::kHasParentLinks, "iterators require a storage with parent links");
     return iterator(nullptr, &storage_);
 }
 
-template <typename T, class RandomGenerator>
-const T& AdvancedVector<T, RandomGenerator>::back() const {
+template <typename T, class RandomGenerator, class Storage>
+typename AdvancedVector<T, RandomGenerator, Storage>::handle_t
+AdvancedVector<T, RandomGenerator, Storage>::handle_at(unsigned position) const {
+    static_assert(Storage::kHasParentLinks, "handles require a storage with parent links");
+    if (position >= size()) {
+        throw std::range_error("handle_at: position is out of range");
+    }
+    return handle_t(GetByIndex(storage_, position));
+}
+
+template <typename T, class RandomGenerator, class Storage>
+size_t AdvancedVector<T, RandomGenerator, Storage>::position(const handle_t& handle) const {
+    static_assert(Storage::kHasParentLinks, "handles require a storage with parent links");
+    auto node = handle.node_.lock();
+    if (node == nullptr) {
+        throw std::invalid_argument("position: element was erased");
+    }
+    auto [position, root] = GetPositionAndRoot(node);
+    if (root != storage_) {
+        if (root->IsDetached()) {
+            throw std::invalid_argument("position: element was erased");
+        }
+        throw std::invalid_argument("position: element belongs to another vector");
+    }
+    return position;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+bool AdvancedVector<T, RandomGenerator, Storage>::precedes(const handle_t& first, const handle_t& second) const {
+    static_assert(Storage::kHasParentLinks, "handles require a storage with parent links");
+    auto first_node = first.node_.lock();
+    auto second_node = second.node_.lock();
+    if (first_node == nullptr || second_node == nullptr) {
+        throw std::invalid_argument("precedes: element was erased");
+    }
+    auto [result, first_root, second_root] = Precedes(first_node, second_node);
+    if (first_root->IsDetached() || second_root->IsDetached()) {
+        throw std::invalid_argument("precedes: element was erased");
+    }
+    if (first_root != storage_ || second_root != storage_) {
+        throw std::invalid_argument("precedes: element belongs to another vector");
+    }
+    return result;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+const T& AdvancedVector<T, RandomGenerator, Storage>::back() const {
     return operator[](size() - 1);
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>&
-AdvancedVector<T, RandomGenerator>::operator+=(const AdvancedVector<T, RandomGenerator>& rhs) {
-    storage_ = Merge(storage_, DeepCopy(rhs.storage_));
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>&
+AdvancedVector<T, RandomGenerator, Storage>::operator+=(const AdvancedVector<T, RandomGenerator, Storage>& rhs) {
+    invalidate_contiguous();
+    storage_ = Merge(std::move(storage_), DeepCopy(rhs.storage_));
     return *this;
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>::AdvancedVector(nodeptr_t<T, unsigned long> node) : storage_(node) {
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>::AdvancedVector(node_pointer node) : storage_(std::move(node)) {
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>&
-AdvancedVector<T, RandomGenerator>::operator+=(AdvancedVector<T, RandomGenerator>&& rhs) {
-    storage_ = Merge(storage_, rhs.storage_);
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>&
+AdvancedVector<T, RandomGenerator, Storage>::operator+=(AdvancedVector<T, RandomGenerator, Storage>&& rhs) {
+    invalidate_contiguous();
+    rhs.invalidate_contiguous();
+    storage_ = Merge(std::move(storage_), std::move(rhs.storage_));
     rhs.storage_ = nullptr;
     return *this;
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>
-AdvancedVector<T, RandomGenerator>::operator+(const AdvancedVector<T, RandomGenerator>& rhs) {
-    return AdvancedVector<T, RandomGenerator>(Merge(DeepCopy(storage_), DeepCopy(rhs.storage_)));
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>
+AdvancedVector<T, RandomGenerator, Storage>::operator+(const AdvancedVector<T, RandomGenerator, Storage>& rhs) {
+    return AdvancedVector<T, RandomGenerator, Storage>(Merge(DeepCopy(storage_), DeepCopy(rhs.storage_)));
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>
-AdvancedVector<T, RandomGenerator>::operator+(AdvancedVector<T, RandomGenerator>&& rhs) {
-    auto tmp = rhs.storage_;
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>
+AdvancedVector<T, RandomGenerator, Storage>::operator+(AdvancedVector<T, RandomGenerator, Storage>&& rhs) {
+    rhs.invalidate_contiguous();
+    auto tmp = std::move(rhs.storage_);
     rhs.storage_ = nullptr;
-    return AdvancedVector<T, RandomGenerator>(Merge(DeepCopy(storage_), tmp));
+    return AdvancedVector<T, RandomGenerator, Storage>(Merge(DeepCopy(storage_), std::move(tmp)));
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 template <typename... Tail>
-AdvancedVector<T, RandomGenerator>::AdvancedVector(AdvancedVector<T, RandomGenerator>&& head, Tail... tail) {
-    AdvancedVector<T, RandomGenerator> tail_vector(std::forward<AdvancedVector<T, RandomGenerator>>(tail)...);
-    storage_ = Merge(head.storage_, tail_vector.storage_);
+AdvancedVector<T, RandomGenerator, Storage>::AdvancedVector(AdvancedVector<T, RandomGenerator, Storage>&& head, Tail... tail) {
+    head.invalidate_contiguous();
+    AdvancedVector<T, RandomGenerator, Storage> tail_vector(std::forward<AdvancedVector<T, RandomGenerator, Storage>>(tail)...);
+    storage_ = Merge(std::move(head.storage_), std::move(tail_vector.storage_));
     head.storage_ = nullptr;
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 template <typename... Tail>
-AdvancedVector<T, RandomGenerator>::AdvancedVector(const AdvancedVector<T, RandomGenerator>& head, Tail... tail) {
-    AdvancedVector<T, RandomGenerator> tail_vector(std::forward<AdvancedVector<T, RandomGenerator>>(tail)...);
-    storage_ = Merge(DeepCopy(head.storage_), tail_vector.storage_);
+AdvancedVector<T, RandomGenerator, Storage>::AdvancedVector(const AdvancedVector<T, RandomGenerator, Storage>& head, Tail... tail) {
+    AdvancedVector<T, RandomGenerator, Storage> tail_vector(std::forward<AdvancedVector<T, RandomGenerator, Storage>>(tail)...);
+    storage_ = Merge(DeepCopy(head.storage_), std::move(tail_vector.storage_));
 }
 
-template <typename T, class RandomGenerator>
-void AdvancedVector<T, RandomGenerator>::clear() {
+template <typename T, class RandomGenerator, class Storage>
+void AdvancedVector<T, RandomGenerator, Storage>::clear() {
+    invalidate_contiguous();
+    retire(std::move(storage_));
     storage_ = nullptr;
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>&
-AdvancedVector<T, RandomGenerator>::operator=(const std::initializer_list<T>& data) {
-    storage_ = nullptr;
+template <typename T, class RandomGenerator, class Storage>
+void AdvancedVector<T, RandomGenerator, Storage>::retire(node_pointer node) {
+    if constexpr (Storage::kHasParentLinks) {
+        // handles that still reach the subtree report it as erased, see Node::IsDetached
+        if (node != nullptr) {
+            node->MarkDetached();
+        }
+    }
+    if (deferred_reclamation_) {
+        DeferredReclaimer::Instance().Retire(std::move(node));
+    }
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdvancedVector<T, RandomGenerator, Storage>::set_deferred_reclamation(bool enabled) {
+    deferred_reclamation_ = enabled;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+bool AdvancedVector<T, RandomGenerator, Storage>::deferred_reclamation() const {
+    return deferred_reclamation_;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>&
+AdvancedVector<T, RandomGenerator, Storage>::operator=(const std::initializer_list<T>& data) {
+    clear();
     for (const auto& elem : data) {
         push_back(elem);
     }
     return *this;
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>&
-AdvancedVector<T, RandomGenerator>::operator=(std::initializer_list<T>&& data) noexcept {
-    storage_ = nullptr;
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>&
+AdvancedVector<T, RandomGenerator, Storage>::operator=(std::initializer_list<T>&& data) noexcept {
+    clear();
     for (const auto& elem : data) {
         push_back(elem);
     }
     return *this;
 }
 
-template <typename T, class RandomGenerator>
+template <typename T, class RandomGenerator, class Storage>
 template <typename It, typename std::enable_if<
         std::is_convertible<typename std::iterator_traits<It>::value_type, T >::value, int
         >::type>
-AdvancedVector<T, RandomGenerator>::AdvancedVector(It first, It last) : storage_(nullptr) {
+AdvancedVector<T, RandomGenerator, Storage>::AdvancedVector(It first, It last) : storage_(nullptr) {
+    std::vector<node_pointer> nodes;
     for (It iter = first; iter != last; ++iter) {
-        push_back(*iter);
+        nodes.push_back(Storage::template MakeNode<T, uint64_t>(*iter, gen()));
     }
+    storage_ = Build(std::move(nodes));
 }
 
-template <typename T, class RandomGenerator>
-void AdvancedVector<T, RandomGenerator>::erase(unsigned position, unsigned length) {
-    auto [first, second, third] = Split(storage_, position, length);
-    storage_ = Merge(first, third);
+template <typename T, class RandomGenerator, class Storage>
+void AdvancedVector<T, RandomGenerator, Storage>::erase(unsigned position, unsigned length) {
+    invalidate_contiguous();
+    auto [first, second, third] = Split(std::move(storage_), position, length);
+    storage_ = Merge(std::move(first), std::move(third));
+    if constexpr (Storage::kHasParentLinks) {
+        // the new root may still point to a parent among the erased nodes, which stay alive
+        // until the reclaimer gets to them
+        if (storage_ != nullptr) {
+            storage_->SetParent(nullptr);
+        }
+    }
+    retire(std::move(second));
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator>& AdvancedVector<T, RandomGenerator>::operator*=(size_t multiplier) {
-    auto tmp_storage = storage_;
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage>& AdvancedVector<T, RandomGenerator, Storage>::operator*=(size_t multiplier) {
+    invalidate_contiguous();
+    auto tmp_storage = std::move(storage_);
     storage_ = nullptr;
     for (size_t iteration = 0; iteration < multiplier; ++iteration) {
-        storage_ = Merge(storage_, DeepCopy(tmp_storage));
+        storage_ = Merge(std::move(storage_), DeepCopy(tmp_storage));
     }
+    retire(std::move(tmp_storage));
     return *this;
 }
 
-template <typename T, class RandomGenerator>
-AdvancedVector<T, RandomGenerator> AdvancedVector<T, RandomGenerator>::operator*(size_t multiplier) {
-    nodeptr_t<T, uint64_t> new_storage_ = nullptr;
+template <typename T, class RandomGenerator, class Storage>
+AdvancedVector<T, RandomGenerator, Storage> AdvancedVector<T, RandomGenerator, Storage>::operator*(size_t multiplier) {
+    node_pointer new_storage_ = nullptr;
     for (size_t iteration = 0; iteration < multiplier; ++iteration) {
-        new_storage_ = Merge(new_storage_, DeepCopy(storage_));
+        new_storage_ = Merge(std::move(new_storage_), DeepCopy(storage_));
     }
-    return AdvancedVector<T, RandomGenerator>(new_storage_);
+    return AdvancedVector<T, RandomGenerator, Storage>(std::move(new_storage_));
 }
 
-template <typename T>
-std::ostream&
-operator<<(std::ostream& output_stream, const AdvancedVector<T>& data) {
-    for (size_t i = 0; i < data.size(); ++i) {
-        output_stream << data[i] << " ";
+namespace AdvancedVectorFlat {
+    static const char kMagic[8] = {'A', 'D', 'V', 'V', 'E', 'C', '\0', '\0'};
+    static const uint32_t kVersion = 1;
+
+    inline uint64_t AlignUp(uint64_t offset) {
+        return (offset + 63) / 64 * 64;
+    }
+
+    template <typename T>
+    AdvancedVectorFlatHeader MakeHeader(uint64_t size) {
+        AdvancedVectorFlatHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.value_size = sizeof(T);
+        header.size = size;
+        header.values_offset = AlignUp(sizeof(AdvancedVectorFlatHeader));
+        header.priorities_offset = AlignUp(header.values_offset + size * sizeof(T));
+        header.total_size = header.priorities_offset + size * sizeof(uint64_t);
+        return header;
     }
+
+    template <typename T>
+    void CheckHeader(const AdvancedVectorFlatHeader& header) {
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion) {
+            throw std::runtime_error("AdvancedVector: unknown snapshot format");
+        }
+        if (header.value_size != sizeof(T)) {
+            throw std::runtime_error("AdvancedVector: snapshot stores values of another size");
+        }
+        auto expected = MakeHeader<T>(header.size);
+        if (header.values_offset != expected.values_offset ||
+                header.priorities_offset != expected.priorities_offset ||
+                header.total_size != expected.total_size) {
+            throw std::runtime_error("AdvancedVector: corrupted snapshot header");
+        }
+    }
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdvancedVector<T, RandomGenerator, Storage>::save(std::ostream& output_stream) const {
+    static_assert(std::is_trivially_copyable<T>::value, "save requires trivially copyable values");
+
+    std::vector<T> values;
+    std::vector<uint64_t> priorities;
+    values.reserve(size());
+    priorities.reserve(size());
+    VisitInOrder(storage_, [&values, &priorities](const auto& node) {
+        values.push_back(node.GetValue());
+        priorities.push_back(node.GetPriority());
+    });
+
+    auto header = AdvancedVectorFlat::MakeHeader<T>(values.size());
+    const char padding[64] = {};
+    output_stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output_stream.write(padding, header.values_offset - sizeof(header));
+    output_stream.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    output_stream.write(padding, header.priorities_offset - header.values_offset - values.size() * sizeof(T));
+    output_stream.write(reinterpret_cast<const char*>(priorities.data()), priorities.size() * sizeof(uint64_t));
+    if (!output_stream) {
+        throw std::runtime_error("AdvancedVector: failed to write snapshot");
+    }
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdvancedVector<T, RandomGenerator, Storage>::load(std::istream& input_stream) {
+    invalidate_contiguous();
+    static_assert(std::is_trivially_copyable<T>::value, "load requires trivially copyable values");
+
+    AdvancedVectorFlatHeader header;
+    if (!input_stream.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        throw std::runtime_error("AdvancedVector: snapshot is too short");
+    }
+    AdvancedVectorFlat::CheckHeader<T>(header);
+
+    std::vector<T> values(header.size);
+    std::vector<uint64_t> priorities(header.size);
+    input_stream.ignore(header.values_offset - sizeof(header));
+    input_stream.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T));
+    input_stream.ignore(header.priorities_offset - header.values_offset - values.size() * sizeof(T));
+    input_stream.read(reinterpret_cast<char*>(priorities.data()), priorities.size() * sizeof(uint64_t));
+    if (!input_stream) {
+        throw std::runtime_error("AdvancedVector: snapshot is too short");
+    }
+
+    std::vector<node_pointer> nodes;
+    nodes.reserve(values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        nodes.push_back(Storage::template MakeNode<T, uint64_t>(values[i], priorities[i]));
+    }
+    // the old tree is dropped only once the snapshot has been read in full
+    auto loaded = Build(std::move(nodes));
+    retire(std::move(storage_));
+    storage_ = std::move(loaded);
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdvancedVector<T, RandomGenerator, Storage>::load(const void* data, size_t size) {
+    invalidate_contiguous();
+    auto [values, count] = flat_values(data, size);
+    const char* bytes = static_cast<const char*>(data);
+    AdvancedVectorFlatHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+
+    std::vector<node_pointer> nodes;
+    nodes.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t priority;
+        std::memcpy(&priority, bytes + header.priorities_offset + i * sizeof(uint64_t), sizeof(priority));
+        nodes.push_back(Storage::template MakeNode<T, uint64_t>(values[i], priority));
+    }
+    auto loaded = Build(std::move(nodes));
+    retire(std::move(storage_));
+    storage_ = std::move(loaded);
+}
+
+template <typename T, class RandomGenerator, class Storage>
+std::pair<const T*, size_t>
+AdvancedVector<T, RandomGenerator, Storage>::flat_values(const void* data, size_t size) {
+    static_assert(std::is_trivially_copyable<T>::value, "snapshots require trivially copyable values");
+
+    AdvancedVectorFlatHeader header;
+    if (size < sizeof(header)) {
+        throw std::runtime_error("AdvancedVector: snapshot is too short");
+    }
+    std::memcpy(&header, data, sizeof(header));
+    AdvancedVectorFlat::CheckHeader<T>(header);
+    if (size < header.total_size) {
+        throw std::runtime_error("AdvancedVector: snapshot is too short");
+    }
+    return std::make_pair(reinterpret_cast<const T*>(static_cast<const char*>(data) + header.values_offset),
+                          static_cast<size_t>(header.size));
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdvancedVector<T, RandomGenerator, Storage>::invalidate_contiguous() {
+    if (is_compacted_) {
+        std::vector<T>().swap(contiguous_);
+        is_compacted_ = false;
+    }
+}
+
+template <typename T, class RandomGenerator, class Storage>
+std::vector<T> AdvancedVector<T, RandomGenerator, Storage>::to_vector() const {
+    std::vector<T> result;
+    result.reserve(size());
+    copy_to(std::back_inserter(result));
+    return result;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+template <typename OutputIt>
+OutputIt AdvancedVector<T, RandomGenerator, Storage>::copy_to(OutputIt destination) const {
+    if (is_compacted_) {
+        return std::copy(contiguous_.begin(), contiguous_.end(), destination);
+    }
+    VisitInOrder(storage_, [&destination](const auto& node) {
+        *destination = node.GetValue();
+        ++destination;
+    });
+    return destination;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdvancedVector<T, RandomGenerator, Storage>::compact() {
+    if (!is_compacted_) {
+        contiguous_ = to_vector();
+        is_compacted_ = true;
+    }
+}
+
+template <typename T, class RandomGenerator, class Storage>
+bool AdvancedVector<T, RandomGenerator, Storage>::is_compacted() const {
+    return is_compacted_;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+typename AdvancedVector<T, RandomGenerator, Storage>::const_span
+AdvancedVector<T, RandomGenerator, Storage>::as_span(unsigned position, unsigned length) const {
+    if (!is_compacted_) {
+        throw std::logic_error("as_span: vector was modified since the last compact()");
+    }
+    if (position > contiguous_.size() || length > contiguous_.size() - position) {
+        throw std::range_error("as_span: range is out of bounds");
+    }
+    return const_span(contiguous_.data() + position, length);
+}
+
+template <typename T, class RandomGenerator, class Storage>
+void AdvancedVector<T, RandomGenerator, Storage>::relayout(NodeLayout layout) {
+    static_assert(std::is_same<Storage, SharedNodeStorage>::value, "relayout requires SharedNodeStorage");
+    invalidate_contiguous();
+    auto relaid = Relayout(storage_, layout);
+    retire(std::move(storage_));
+    storage_ = std::move(relaid);
+}
+
+template <typename T, class RandomGenerator, class Storage>
+template <typename Compare>
+void AdvancedVector<T, RandomGenerator, Storage>::sort_values(std::vector<T>& values, Compare comp) {
+    size_t threads = std::min<size_t>(std::thread::hardware_concurrency(), values.size() / kParallelSortGrain);
+    if (threads < 2) {
+        std::sort(values.begin(), values.end(), comp);
+        return;
+    }
+
+    std::vector<size_t> bounds(threads + 1);
+    for (size_t i = 0; i <= threads; ++i) {
+        bounds[i] = values.size() * i / threads;
+    }
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([&values, &bounds, comp, i]() {
+            std::sort(values.begin() + bounds[i], values.begin() + bounds[i + 1], comp);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (size_t width = 1; width < threads; width *= 2) {
+        for (size_t i = 0; i + width < threads; i += 2 * width) {
+            std::inplace_merge(values.begin() + bounds[i], values.begin() + bounds[i + width],
+                               values.begin() + bounds[std::min(i + 2 * width, threads)], comp);
+        }
+    }
+}
+
+template <typename T, class RandomGenerator, class Storage>
+template <typename Compare>
+void AdvancedVector<T, RandomGenerator, Storage>::sort(Compare comp) {
+    invalidate_contiguous();
+    std::vector<T> values;
+    values.reserve(size());
+    VisitInOrder(storage_, [&values](auto& node) {
+        values.push_back(std::move(node.GetValue()));
+    });
+
+    sort_values(values, comp);
+
+    auto value = values.begin();
+    VisitInOrder(storage_, [&value](auto& node) {
+        node.GetValue() = std::move(*value);
+        ++value;
+    });
+}
+
+template <typename T, class RandomGenerator, class Storage>
+template <typename Compare>
+void AdvancedVector<T, RandomGenerator, Storage>::merge_sorted(AdvancedVector<T, RandomGenerator, Storage>&& other,
+                                                               Compare comp) {
+    invalidate_contiguous();
+    other.invalidate_contiguous();
+    storage_ = MergeSorted(std::move(storage_), std::move(other.storage_), comp);
+    other.storage_ = nullptr;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+template <typename Compare>
+void AdvancedVector<T, RandomGenerator, Storage>::merge_sorted(const AdvancedVector<T, RandomGenerator, Storage>& other,
+                                                               Compare comp) {
+    merge_sorted(AdvancedVector<T, RandomGenerator, Storage>(other), comp);
+}
+
+template <typename T, class RandomGenerator, class Storage>
+template <typename Compare>
+size_t AdvancedVector<T, RandomGenerator, Storage>::lower_bound(const T& value, Compare comp) const {
+    return CountByValue(storage_, value, comp, false);
+}
+
+template <typename T, class RandomGenerator, class Storage>
+template <typename Compare>
+size_t AdvancedVector<T, RandomGenerator, Storage>::upper_bound(const T& value, Compare comp) const {
+    return CountByValue(storage_, value, comp, true);
+}
+
+template <typename T, class RandomGenerator, class Storage>
+template <typename Compare>
+size_t AdvancedVector<T, RandomGenerator, Storage>::insert_sorted(const T& value, Compare comp) {
+    invalidate_contiguous();
+    unsigned position = 0;
+    storage_ = InsertByValue(std::move(storage_), value, static_cast<uint64_t>(gen()), comp, position);
+    return position;
+}
+
+template <typename T, class RandomGenerator, class Storage>
+template <typename Compare>
+AdvancedVector<T, RandomGenerator, Storage>
+AdvancedVector<T, RandomGenerator, Storage>::split_by_value(const T& value, Compare comp) {
+    invalidate_contiguous();
+    auto [head, tail] = SplitByValue(std::move(storage_), value, comp, false);
+    storage_ = std::move(head);
+    return AdvancedVector<T, RandomGenerator, Storage>(std::move(tail));
+}
+
+template <typename T, class RandomGenerator, class Storage>
+std::ostream&
+operator<<(std::ostream& output_stream, const AdvancedVector<T, RandomGenerator, Storage>& data) {
+    data.copy_to(std::ostream_iterator<T>(output_stream, " "));
     return output_stream;
 }
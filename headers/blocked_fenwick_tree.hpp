@@ -0,0 +1,61 @@
+#ifndef HEADER_BLOCKED_FENWICK_TREE_INCLUDED
+#define HEADER_BLOCKED_FENWICK_TREE_INCLUDED
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "fenwick_tree.hpp"
+
+/*
+Блочное дерево Фенвика: элементы разбиты на блоки размером с кэш-линию (64 байта), внутри блока
+хранятся префиксные комбинации его элементов, а над комбинациями целых блоков строится обычное
+дерево Фенвика. Операции те же, что у FenwickTree:
+1) Префикс и сумма на отрезке - одна кэш-линия блока и проход по дереву блоков за O(log(N / B))
+2) Изменение элемента - не более B комбинаций внутри одной кэш-линии и проход по дереву блоков
+3) Значение элемента за O(1)
+Дерево блоков в B раз меньше массива, поэтому случайные проходы реже уходят в память;
+с HugePageAllocator в качестве Alloc и блоки, и дерево блоков лежат на страницах по 2 МБ.
+*/
+
+template< typename T, typename Op = FenwickSum< T >, typename Alloc = std::allocator< T > >
+class BlockedFenwickTree
+{
+private:
+	static constexpr size_t _cache_line = 64;
+	static constexpr size_t _block_size = std::max< size_t >( 1, _cache_line / sizeof( T ) );
+
+	// values[i] combines elements [0, i] of the block
+	struct alignas( _cache_line ) _Block {
+		T values[_block_size];
+	};
+	typedef typename std::allocator_traits< Alloc >::template rebind_alloc< _Block > _block_allocator;
+
+	std::vector< _Block, _block_allocator >		_blocks;
+	// combinations of whole blocks
+	FenwickTree< T, Op, Alloc >					_tops;
+	size_t										_size;
+
+	// combination of elements [0, right], identity for right == -1
+	T              _prefix_sum  ( int right ) const;
+
+public:
+    // initialization with identity elements
+    BlockedFenwickTree		( size_t size );
+    // initialization from vector
+    BlockedFenwickTree		( const std::vector< T >& );
+    // combine some element with delta (increment for sums)
+    void            inc     ( int index, const T& delta );
+    // sum of subarray, for invertible operations
+    T               sum     ( int left, int right ) const;
+    // combination of elements [0, right], for any operation
+    T               prefix  ( int right ) const;
+    // return element of array, for invertible operations
+    T               operator [] ( size_t index ) const;
+    // set the value of element
+    void            set     ( size_t index, const T& value );
+    size_t          size    () const;
+};
+
+#include "blocked_fenwick_tree_methods.hpp"
+#endif
@@ -0,0 +1,98 @@
+#ifndef HEADER_BLOCKED_FENWICK_TREE_METHODS_INCLUDED
+#define HEADER_BLOCKED_FENWICK_TREE_METHODS_INCLUDED
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+
+#include "blocked_fenwick_tree.hpp"
+
+template< typename T, typename Op, typename Alloc >
+BlockedFenwickTree< T, Op, Alloc >::BlockedFenwickTree ( size_t size ) :
+        _blocks( ( size + _block_size - 1 ) / _block_size ), _tops( _blocks.size() ), _size( size ) {
+    for ( _Block& block : _blocks )
+        std::fill( block.values, block.values + _block_size, Op::identity() );
+}
+
+template< typename T, typename Op, typename Alloc >
+BlockedFenwickTree< T, Op, Alloc >::BlockedFenwickTree ( const std::vector< T >& array ) :
+        _blocks( ( array.size() + _block_size - 1 ) / _block_size ), _tops( 0 ), _size( array.size() ) {
+    std::vector< T > totals( _blocks.size() );
+    for ( size_t block = 0; block < _blocks.size(); block++ ) {
+        // slots past the end of the array repeat the total of the last block and are never read
+        T running = Op::identity();
+        for ( size_t i = 0; i < _block_size; i++ ) {
+            size_t index = block * _block_size + i;
+            if ( index < array.size() )
+                running = Op::combine( running, array[index] );
+            _blocks[block].values[i] = running;
+        }
+        totals[block] = running;
+    }
+    _tops = FenwickTree< T, Op, Alloc >( totals );
+}
+
+template< typename T, typename Op, typename Alloc >
+void BlockedFenwickTree< T, Op, Alloc >::inc ( int index, const T& delta ) {
+    if ( index < 0 || index >= ( int )_size )
+        throw std::range_error( "inc:: Index must be greater then zero and less then size of tree" );
+
+    T* values = _blocks[index / _block_size].values;
+    for ( size_t i = index % _block_size; i < _block_size; i++ )
+        values[i] = Op::combine( values[i], delta );
+    _tops.inc( index / _block_size, delta );
+}
+
+template< typename T, typename Op, typename Alloc >
+T BlockedFenwickTree< T, Op, Alloc >::_prefix_sum ( int right ) const {
+    if ( right < 0 )
+        return Op::identity();
+    size_t block = right / _block_size;
+    T result = _blocks[block].values[right % _block_size];
+    if ( block > 0 )
+        result = Op::combine( result, _tops.prefix( block - 1 ) );
+    return result;
+}
+
+template< typename T, typename Op, typename Alloc >
+T BlockedFenwickTree< T, Op, Alloc >::prefix ( int right ) const {
+    if ( right < 0 || right >= ( int )_size )
+        throw std::range_error( "prefix:: Index must be greater then zero and less then size of tree" );
+    return _prefix_sum( right );
+}
+
+template< typename T, typename Op, typename Alloc >
+T BlockedFenwickTree< T, Op, Alloc >::sum ( int left, int right ) const {
+    static_assert( Op::invertible, "sum:: operation is not invertible, use prefix" );
+    if ( left > right )
+        std::swap( left, right );
+    if ( left < 0 || right >= ( int )_size )
+        throw std::range_error( "sum:: Index must be greater then zero and less then size of tree" );
+
+    return Op::inverse( _prefix_sum( right ), _prefix_sum( left - 1 ) );
+}
+
+template< typename T, typename Op, typename Alloc >
+T BlockedFenwickTree< T, Op, Alloc >::operator [] ( size_t index ) const {
+    static_assert( Op::invertible, "operation is not invertible, single elements are not stored" );
+    if ( index >= _size )
+        throw std::range_error( "opeartor[]:: Index must be greater then zero and less then size of tree" );
+
+    const T* values = _blocks[index / _block_size].values;
+    size_t offset = index % _block_size;
+    return offset == 0 ? values[0] : Op::inverse( values[offset], values[offset - 1] );
+}
+
+template< typename T, typename Op, typename Alloc >
+void BlockedFenwickTree< T, Op, Alloc >::set ( size_t index, const T& value ) {
+    if ( index >= _size )
+        throw std::range_error( "set:: Index must be greater then zero and less then size of tree" );
+
+    inc( index, Op::inverse( value, ( *this )[index] ) );
+}
+
+template< typename T, typename Op, typename Alloc >
+size_t BlockedFenwickTree< T, Op, Alloc >::size () const {
+    return _size;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef HEADER_CARTESIAN_TREE_INCLUDED
+#define HEADER_CARTESIAN_TREE_INCLUDED
+
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+/*
+Статическое декартово дерево над неизменяемым массивом. Строится стеком за O(n): корень - самый
+левый минимум массива, левое и правое поддеревья - декартовы деревья частей слева и справа от него.
+Минимум на отрезке - это наименьший общий предок концов отрезка, запрос отвечается за O(1)
+без обхода дерева:
+1) массив разбит на блоки по 64 элемента, для каждого элемента хранится 64-битная маска стека
+   минимумов своего блока, минимум внутри блока находится одной инструкцией ctz
+2) над минимумами блоков строится разреженная таблица, O(n / 64 * log n) памяти
+Вместе с деревом это около 20 байт на элемент сверх самих значений. С Compare = std::greater
+дерево строится по максимумам, а запрос возвращает максимум.
+*/
+
+template< typename T, typename Compare = std::less< T > >
+class CartesianTree
+{
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+private:
+	static constexpr size_t _block = 64;
+
+	std::vector< T >		_values;
+	Compare					_compare;
+	uint32_t				_root;
+	std::vector< uint32_t >	_parent;
+	std::vector< uint32_t >	_left;
+	std::vector< uint32_t >	_right;
+	// bit i of _masks[j] is set if element (j / 64 * 64 + i) is on the minimum stack after pushing j
+	std::vector< uint64_t >	_masks;
+	// level k holds the leftmost minimum of blocks [b, b + 2^k)
+	std::vector< std::vector< uint32_t > >	_sparse;
+
+	void		_build		();
+	// leftmost minimum of [left, right] inside one block
+	uint32_t	_in_block	( size_t left, size_t right ) const;
+	// the better of two indices, the left one on ties
+	uint32_t	_better		( uint32_t left, uint32_t right ) const;
+
+public:
+    CartesianTree           ( const std::vector< T >&, Compare compare = Compare() );
+    CartesianTree           ( std::vector< T >&&, Compare compare = Compare() );
+    // index of the leftmost minimum of [left, right], O(1)
+    size_t          query_index ( size_t left, size_t right ) const;
+    // value of the minimum of [left, right], O(1)
+    const T&        query       ( size_t left, size_t right ) const;
+    const T&        operator [] ( size_t index ) const;
+    size_t          size    () const;
+    // tree structure, npos for a missing node
+    uint32_t        root    () const;
+    uint32_t        parent  ( size_t index ) const;
+    uint32_t        left    ( size_t index ) const;
+    uint32_t        right   ( size_t index ) const;
+};
+
+#include "cartesian_tree_methods.hpp"
+#endif
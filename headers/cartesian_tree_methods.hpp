@@ -0,0 +1,150 @@
+#ifndef HEADER_CARTESIAN_TREE_METHODS_INCLUDED
+#define HEADER_CARTESIAN_TREE_METHODS_INCLUDED
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
+
+#include "cartesian_tree.hpp"
+
+template< typename T, typename Compare >
+CartesianTree< T, Compare >::CartesianTree ( const std::vector< T >& array, Compare compare ) : _values( array ), _compare( compare ) {
+    _build();
+}
+
+template< typename T, typename Compare >
+CartesianTree< T, Compare >::CartesianTree ( std::vector< T >&& array, Compare compare ) : _values( std::move( array ) ), _compare( compare ) {
+    _build();
+}
+
+template< typename T, typename Compare >
+void CartesianTree< T, Compare >::_build () {
+    if ( _values.size() >= npos )
+        throw std::length_error( "CartesianTree:: Array is too large" );
+
+    size_t n = _values.size();
+    _root = npos;
+    _parent.assign( n, npos );
+    _left.assign( n, npos );
+    _right.assign( n, npos );
+    _masks.resize( n );
+
+    // right spine of the tree built so far, its values are non-decreasing from the bottom;
+    // a new element pops the strictly greater ones, so equal elements keep the left one on top
+    std::vector< uint32_t > stack;
+    stack.reserve( 64 );
+    uint64_t mask = 0;
+    for ( uint32_t i = 0; i < n; i++ ) {
+        if ( i % _block == 0 )
+            mask = 0;
+        uint32_t last = npos;
+        while ( !stack.empty() && _compare( _values[i], _values[stack.back()] ) ) {
+            last = stack.back();
+            if ( last / _block == i / _block )
+                mask &= ~( uint64_t( 1 ) << ( last % _block ) );
+            stack.pop_back();
+        }
+        if ( last != npos ) {
+            _left[i] = last;
+            _parent[last] = i;
+        }
+        if ( !stack.empty() ) {
+            _right[stack.back()] = i;
+            _parent[i] = stack.back();
+        }
+        stack.push_back( i );
+        mask |= uint64_t( 1 ) << ( i % _block );
+        _masks[i] = mask;
+    }
+    if ( !stack.empty() )
+        _root = stack.front();
+
+    size_t blocks = ( n + _block - 1 ) / _block;
+    _sparse.clear();
+    if ( blocks == 0 )
+        return;
+    _sparse.emplace_back( blocks );
+    for ( size_t b = 0; b < blocks; b++ )
+        _sparse[0][b] = _in_block( b * _block, std::min( n, ( b + 1 ) * _block ) - 1 );
+    for ( size_t width = 1; 2 * width <= blocks; width *= 2 ) {
+        const std::vector< uint32_t >& previous = _sparse.back();
+        std::vector< uint32_t > level( blocks - 2 * width + 1 );
+        for ( size_t b = 0; b < level.size(); b++ )
+            level[b] = _better( previous[b], previous[b + width] );
+        _sparse.push_back( std::move( level ) );
+    }
+}
+
+template< typename T, typename Compare >
+uint32_t CartesianTree< T, Compare >::_in_block ( size_t left, size_t right ) const {
+    // the lowest stack element at or after left is the leftmost minimum of [left, right]
+    uint64_t mask = _masks[right] & ( ~uint64_t( 0 ) << ( left % _block ) );
+    return uint32_t( right - right % _block + __builtin_ctzll( mask ) );
+}
+
+template< typename T, typename Compare >
+uint32_t CartesianTree< T, Compare >::_better ( uint32_t left, uint32_t right ) const {
+    return _compare( _values[right], _values[left] ) ? right : left;
+}
+
+template< typename T, typename Compare >
+size_t CartesianTree< T, Compare >::query_index ( size_t left, size_t right ) const {
+    if ( left > right )
+        std::swap( left, right );
+    if ( right >= _values.size() )
+        throw std::range_error( "query:: Index must be less then size of tree" );
+
+    size_t first = left / _block, last = right / _block;
+    if ( first == last )
+        return _in_block( left, right );
+
+    uint32_t result = _in_block( left, first * _block + _block - 1 );
+    if ( first + 1 < last ) {
+        // two overlapping power-of-two ranges cover the blocks in between
+        size_t count = last - first - 1;
+        size_t level = 63 - __builtin_clzll( count );
+        result = _better( result, _sparse[level][first + 1] );
+        result = _better( result, _sparse[level][last - ( size_t( 1 ) << level )] );
+    }
+    return _better( result, _in_block( last * _block, right ) );
+}
+
+template< typename T, typename Compare >
+const T& CartesianTree< T, Compare >::query ( size_t left, size_t right ) const {
+    return _values[query_index( left, right )];
+}
+
+template< typename T, typename Compare >
+const T& CartesianTree< T, Compare >::operator [] ( size_t index ) const {
+    if ( index >= _values.size() )
+        throw std::range_error( "operator[]:: Index must be less then size of tree" );
+    return _values[index];
+}
+
+template< typename T, typename Compare >
+size_t CartesianTree< T, Compare >::size () const {
+    return _values.size();
+}
+
+template< typename T, typename Compare >
+uint32_t CartesianTree< T, Compare >::root () const {
+    return _root;
+}
+
+template< typename T, typename Compare >
+uint32_t CartesianTree< T, Compare >::parent ( size_t index ) const {
+    return _parent.at( index );
+}
+
+template< typename T, typename Compare >
+uint32_t CartesianTree< T, Compare >::left ( size_t index ) const {
+    return _left.at( index );
+}
+
+template< typename T, typename Compare >
+uint32_t CartesianTree< T, Compare >::right ( size_t index ) const {
+    return _right.at( index );
+}
+
+#endif
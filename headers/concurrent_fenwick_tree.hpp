@@ -0,0 +1,48 @@
+#ifndef HEADER_CONCURRENT_FENWICK_TREE_INCLUDED
+#define HEADER_CONCURRENT_FENWICK_TREE_INCLUDED
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+/*
+Потокобезопасное дерево Фенвика для счетчиков, которые увеличиваются из многих потоков.
+Два режима:
+1) atomic - одно дерево из std::atomic< T >, inc выполняет relaxed fetch_add по пути обновления.
+   sum читает узлы relaxed-загрузками: результат учитывает все inc, завершившиеся до начала
+   sum, и любое подмножество одновременных с ним.
+2) sharded - у каждого потока свое дерево (потоки распределяются по шардам по кругу), inc
+   пишет только в свой шард и не конкурирует за кэш-линии с другими потоками, а sum
+   складывает ответы всех шардов. Чтение в (число шардов) раз дороже.
+Операции set нет: присваивание не коммутирует с параллельными inc.
+*/
+
+enum class FenwickConcurrency { atomic, sharded };
+
+template< typename T, FenwickConcurrency Mode = FenwickConcurrency::atomic >
+class ConcurrentFenwickTree
+{
+private:
+	size_t									_size;
+	std::vector< std::unique_ptr< std::atomic< T >[] > >	_shards;
+
+	static size_t	_thread_slot	();
+	static void		_atomic_add		( std::atomic< T >& target, const T& delta );
+	T				_prefix_sum		( int right ) const;
+
+public:
+    // zero initialization, shards == 0 means one shard per hardware thread
+    ConcurrentFenwickTree	( size_t size, size_t shards = 0 );
+    // increment some element, safe to call from any thread
+    void            inc     ( int index, const T& delta );
+    // sum of subarray, safe to call from any thread
+    T               sum     ( int left, int right ) const;
+    // return element of array
+    T               operator [] ( size_t index ) const;
+    // number of elements
+    size_t          size    () const;
+};
+
+#include "concurrent_fenwick_tree_methods.hpp"
+#endif
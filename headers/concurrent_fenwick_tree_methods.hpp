@@ -0,0 +1,85 @@
+#ifndef HEADER_CONCURRENT_FENWICK_TREE_METHODS_INCLUDED
+#define HEADER_CONCURRENT_FENWICK_TREE_METHODS_INCLUDED
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <algorithm>
+#include <utility>
+
+#include "concurrent_fenwick_tree.hpp"
+
+template< typename T, FenwickConcurrency Mode >
+ConcurrentFenwickTree< T, Mode >::ConcurrentFenwickTree ( size_t size, size_t shards ) : _size( size ) {
+    if ( Mode == FenwickConcurrency::atomic )
+        shards = 1;
+    else if ( shards == 0 )
+        shards = std::max( 1u, std::thread::hardware_concurrency() );
+
+    for ( size_t shard = 0; shard < shards; shard++ ) {
+        _shards.emplace_back( new std::atomic< T >[size] );
+        for ( size_t i = 0; i < size; i++ )
+            _shards.back()[i].store( T( 0 ), std::memory_order_relaxed );
+    }
+}
+
+template< typename T, FenwickConcurrency Mode >
+size_t ConcurrentFenwickTree< T, Mode >::_thread_slot () {
+    static std::atomic< size_t > next_slot( 0 );
+    thread_local size_t slot = next_slot.fetch_add( 1, std::memory_order_relaxed );
+    return slot;
+}
+
+template< typename T, FenwickConcurrency Mode >
+void ConcurrentFenwickTree< T, Mode >::_atomic_add ( std::atomic< T >& target, const T& delta ) {
+    if constexpr ( std::is_integral< T >::value ) {
+        target.fetch_add( delta, std::memory_order_relaxed );
+    } else {
+        T expected = target.load( std::memory_order_relaxed );
+        while ( !target.compare_exchange_weak( expected, expected + delta, std::memory_order_relaxed ) ) {}
+    }
+}
+
+template< typename T, FenwickConcurrency Mode >
+void ConcurrentFenwickTree< T, Mode >::inc ( int index, const T& delta ) {
+    if ( index < 0 || index >= ( int )_size )
+        throw std::range_error( "inc:: Index must be greater then zero and less then size of tree" );
+
+    std::atomic< T >* tree = _shards[_shards.size() == 1 ? 0 : _thread_slot() % _shards.size()].get();
+    for ( ; index < ( int )_size; index = (index | (index + 1)) )
+        _atomic_add( tree[index], delta );
+}
+
+template< typename T, FenwickConcurrency Mode >
+T ConcurrentFenwickTree< T, Mode >::_prefix_sum ( int right ) const {
+    T result = 0;
+    for ( const auto& tree : _shards )
+        for ( int index = right; index >= 0; index = (index & (index + 1)) - 1 )
+            result += tree[index].load( std::memory_order_relaxed );
+    return result;
+}
+
+template< typename T, FenwickConcurrency Mode >
+T ConcurrentFenwickTree< T, Mode >::sum ( int left, int right ) const {
+    if ( left > right )
+        std::swap( left, right );
+    if ( left < 0 || right >= ( int )_size )
+        throw std::range_error( "sum:: Index must be greater then zero and less then size of tree" );
+
+    return _prefix_sum( right ) - _prefix_sum( left - 1 );
+}
+
+template< typename T, FenwickConcurrency Mode >
+T ConcurrentFenwickTree< T, Mode >::operator [] ( size_t index ) const {
+    if ( index >= _size )
+        throw std::range_error( "opeartor[]:: Index must be greater then zero and less then size of tree" );
+    return sum( index, index );
+}
+
+template< typename T, FenwickConcurrency Mode >
+size_t ConcurrentFenwickTree< T, Mode >::size () const {
+    return _size;
+}
+
+#endif
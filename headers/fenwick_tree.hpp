@@ -4,35 +4,105 @@
 #include <iostream>
 #include <vector>
 #include <iterator>
+#include <limits>
+#include <algorithm>
+#include <utility>
+#include <memory>
 
 /*
 Дерево Фенвика - это структура данных на массиве, позволяющая выполнять следующие операции:
 1) Вычислять сумму элементов на некотором отрезке за O(log N)
 2) Позволяет изменять значение произвольного элемента за O(log N)
-3) Возвращает значение произвольного элемента за O(log N)
+3) Возвращает значение произвольного элемента в среднем за O(1) (в худшем случае за O(log N)),
+   поэтому присваивание элементу стоит одного прохода обновления
+4) Добавляет элемент в конец за амортизированное O(1) (память растет как у std::vector)
+5) Выполняет пакеты из K изменений за O(min(K log N, N + K)), а пакеты из K запросов суммы
+   обрабатывает в несколько независимых потоков (lanes), чтобы промахи кэша перекрывались
 */
 
-template<typename T>
-class FenwickTree : private std::vector< T >
+/*
+Операция дерева задается политикой Op: ассоциативная и коммутативная combine с нейтральным элементом
+identity(). Для обратимых операций (inverse(combine(a, b), b) == a) доступны суммы на отрезках,
+значения элементов и присваивание; для необратимых (max, min) - только префиксы prefix(), а inc
+объединяет элемент с переданным значением. Все вызовы разрешаются при компиляции.
+Память узлов выделяет Alloc; HugePageAllocator из huge_page_allocator.hpp отдает большие деревья
+страницами по 2 МБ.
+*/
+
+template< typename T >
+struct FenwickSum {
+    static constexpr bool invertible = true;
+    static constexpr T identity () { return T( 0 ); }
+    static T combine ( const T& lhs, const T& rhs ) { return lhs + rhs; }
+    // lhs without rhs
+    static T inverse ( const T& lhs, const T& rhs ) { return lhs - rhs; }
+};
+
+template< typename T >
+struct FenwickXor {
+    static constexpr bool invertible = true;
+    static constexpr T identity () { return T( 0 ); }
+    static T combine ( const T& lhs, const T& rhs ) { return lhs ^ rhs; }
+    static T inverse ( const T& lhs, const T& rhs ) { return lhs ^ rhs; }
+};
+
+template< typename T >
+struct FenwickMax {
+    static constexpr bool invertible = false;
+    static constexpr T identity () { return std::numeric_limits< T >::lowest(); }
+    static T combine ( const T& lhs, const T& rhs ) { return std::max( lhs, rhs ); }
+};
+
+template< typename T >
+struct FenwickMin {
+    static constexpr bool invertible = false;
+    static constexpr T identity () { return std::numeric_limits< T >::max(); }
+    static T combine ( const T& lhs, const T& rhs ) { return std::min( lhs, rhs ); }
+};
+
+template< typename T, typename Op = FenwickSum< T >, typename Alloc = std::allocator< T > >
+class FenwickTree : private std::vector< T, Alloc >
 {
 private:
+	typedef std::vector< T, Alloc > _storage;
+
+	static constexpr size_t _batch_lanes = 8;
+
 	T              _prefix_sum  ( int right ) const;
+	// value of a single element, walks only over the trailing ones of index
+	T              _point_value ( int index ) const;
+	// prefix sums for many right borders walked in lockstep
+	void           _prefix_sum_lanes ( const int* rights, T* results, size_t count ) const;
+	// turns an array of values into a tree in place, O(n)
+	static void    _build       ( _storage& values );
 	
 public:
-    // zero initialization
+    // initialization with identity elements
     FenwickTree				( size_t size );
     // initialization from vector
     FenwickTree             ( const std::vector< T >& );
-    // increment some element
+    // combine some element with delta (increment for sums)
     void            inc     ( int index, const T& delta );
     void            inc     ( int index, T&& delta );
-    // sum of subarray
+    // sum of subarray, for invertible operations
     T               sum     ( int left, int right ) const;
-    // return element of array
+    // combination of elements [0, right], for any operation
+    T               prefix  ( int right ) const;
+    // return element of array, for invertible operations
     T               operator [] ( size_t index ) const;
     // set the value of element
     void            set     ( size_t index, const T& value );
     void            set     ( size_t index, T&& value );
+    // append element, the new node only needs the nodes it covers
+    void            push_back   ( const T& value );
+    // grow with identity elements or drop elements from the end
+    void            resize      ( size_t size );
+    void            reserve     ( size_t capacity );
+    using _storage::size;
+    // increment many elements, deltas[i] is added to indices[i]
+    void            inc_batch   ( const std::vector< int >& indices, const std::vector< T >& deltas );
+    // sums of many subarrays, out[i] = sum( ranges[i].first, ranges[i].second )
+    void            sum_batch   ( const std::vector< std::pair< int, int > >& ranges, std::vector< T >& out ) const;
 };
 
 /* Префиксное дерево: структура данных, реализованная поверх дерева Фенвика, позволяющая выполнять
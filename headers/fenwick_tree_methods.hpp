@@ -3,80 +3,257 @@
 #include <iostream>
 #include <exception>
 #include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include "fenwick_tree.hpp"
 
-template< typename T >
-FenwickTree< T >::FenwickTree ( size_t size ) {
-    this->resize( size );
+template< typename T, typename Op, typename Alloc >
+FenwickTree< T, Op, Alloc >::FenwickTree ( size_t size ) : _storage( size, Op::identity() ) {
+}
+
+template< typename T, typename Op, typename Alloc >
+FenwickTree< T, Op, Alloc >::FenwickTree ( const std::vector< T >& array ) : _storage( array.begin(), array.end() ) {
+    _build( *this );
 }
 
-template< typename T >
-FenwickTree< T >::FenwickTree ( const std::vector< T >& array ) {
-    this->resize( array.size() );
-    for ( size_t i = 0; i < this->size(); i++ ) 
-        inc( i, array[i] );
+template< typename T, typename Op, typename Alloc >
+void FenwickTree< T, Op, Alloc >::_build ( _storage& values ) {
+    // every node pushes its accumulated value to the closest node covering it
+    for ( size_t i = 0; i < values.size(); i++ ) {
+        size_t parent = i | (i + 1);
+        if ( parent < values.size() )
+            values[parent] = Op::combine( values[parent], values[i] );
+    }
 }
 
-template< typename T >
-void FenwickTree< T >::inc ( int index, const T& delta ) {
+template< typename T, typename Op, typename Alloc >
+void FenwickTree< T, Op, Alloc >::inc ( int index, const T& delta ) {
     if ( index < 0 || index >= ( int )this->size() ) 
         throw std::range_error( "inc:: Index must be greater then zero and less then size of tree" );
         
     for ( ; index < ( int )this->size(); index = (index | (index + 1)) ) 
-        this->at(index) += delta;
+        this->at(index) = Op::combine( this->at(index), delta );
 }
 
-template< typename T >
-void FenwickTree< T >::inc ( int index, T&& delta ) {
+template< typename T, typename Op, typename Alloc >
+void FenwickTree< T, Op, Alloc >::inc ( int index, T&& delta ) {
     if ( index < 0 || index >= ( int )this->size() ) 
         throw std::range_error( "inc:: Index must be greater then zero and less then size of tree" );
     
     for ( ; index < ( int )this->size(); index = (index | (index + 1)) ) 
-        this->at(index) += delta;
+        this->at(index) = Op::combine( this->at(index), delta );
 }
 
-template< typename T >
-T FenwickTree< T >::_prefix_sum(int right) const {    
-    T result = 0;
+template< typename T, typename Op, typename Alloc >
+T FenwickTree< T, Op, Alloc >::_prefix_sum(int right) const {    
+    T result = Op::identity();
     for(; right >= 0; right = (right & (right + 1)) - 1)
-        result += this->at( right );
+        result = Op::combine( result, this->at( right ) );
     return result;
 }
 
-template< typename T >
-T FenwickTree< T >::sum( int left, int right ) const {
+template< typename T, typename Op, typename Alloc >
+T FenwickTree< T, Op, Alloc >::prefix ( int right ) const {
+    if ( right < 0 || right >= ( int )this->size() )
+        throw std::range_error( "prefix:: Index must be greater then zero and less then size of tree" );
+    return _prefix_sum( right );
+}
+
+template< typename T, typename Op, typename Alloc >
+T FenwickTree< T, Op, Alloc >::sum( int left, int right ) const {
+    static_assert( Op::invertible, "sum:: operation is not invertible, use prefix" );
     if ( left > right )
         std::swap( left, right );   
     if ( left < 0 || right >= ( int )this->size() )
         throw std::range_error( "sum:: Index must be greater then zero and less then size of tree" );
     
-    return _prefix_sum( right ) - _prefix_sum( left - 1 );
+    return Op::inverse( _prefix_sum( right ), _prefix_sum( left - 1 ) );
+}
+
+template< typename T, typename Op, typename Alloc >
+T FenwickTree< T, Op, Alloc >::_point_value ( int index ) const {
+    static_assert( Op::invertible, "operation is not invertible, single elements are not stored" );
+    // node index covers [index & (index + 1), index], its children cover the rest of that range
+    T result = _storage::operator[]( index );
+    int stop = (index & (index + 1)) - 1;
+    for ( int child = index - 1; child != stop; child = (child & (child + 1)) - 1 )
+        result = Op::inverse( result, _storage::operator[]( child ) );
+    return result;
 }
 
-template< typename T >
-T FenwickTree< T >::operator [] ( size_t index ) const {
-    if ( index > this->size() )
+template< typename T, typename Op, typename Alloc >
+T FenwickTree< T, Op, Alloc >::operator [] ( size_t index ) const {
+    if ( index >= this->size() )
         throw std::range_error( "opeartor[]:: Index must be greater then zero and less then size of tree" );
-    return sum( index, index );
+    return _point_value( index );
 }
 
-template< typename T >
-void FenwickTree< T >::set( size_t index, const T& value) {
+template< typename T, typename Op, typename Alloc >
+void FenwickTree< T, Op, Alloc >::set( size_t index, const T& value) {
     if ( index >= this->size() )
         throw std::range_error( "set:: Index must be greater then zero and less then size of tree" );
     
-    T delta = value - sum( index, index );
+    T delta = Op::inverse( value, _point_value( index ) );
     inc ( index, delta );
 }
 
-template< typename T >
-void FenwickTree< T >::set( size_t index, T&& value) {
+template< typename T, typename Op, typename Alloc >
+void FenwickTree< T, Op, Alloc >::set( size_t index, T&& value) {
     if ( index >= this->size() )
         throw std::range_error( "set:: Index must be greater then zero and less then size of tree" );
     
-    T delta = value - sum( index, index );
+    T delta = Op::inverse( value, _point_value( index ) );
     inc ( index, delta );
 }
 
+template< typename T, typename Op, typename Alloc >
+void FenwickTree< T, Op, Alloc >::push_back ( const T& value ) {
+    // node index covers [index & (index + 1), index], the rest of that range is already summed in its children
+    int index = this->size();
+    T node = value;
+    int stop = (index & (index + 1)) - 1;
+    for ( int child = index - 1; child != stop; child = (child & (child + 1)) - 1 )
+        node = Op::combine( node, _storage::operator[]( child ) );
+    _storage::push_back( node );
+}
+
+template< typename T, typename Op, typename Alloc >
+void FenwickTree< T, Op, Alloc >::resize ( size_t size ) {
+    // nodes never cover elements to the right of them, so a prefix of the tree is a valid tree
+    if ( size <= this->size() ) {
+        _storage::resize( size );
+        return;
+    }
+    _storage::reserve( size );
+    while ( this->size() < size )
+        push_back( Op::identity() );
+}
+
+template< typename T, typename Op, typename Alloc >
+void FenwickTree< T, Op, Alloc >::reserve ( size_t capacity ) {
+    _storage::reserve( capacity );
+}
+
+template< typename T, typename Op, typename Alloc >
+void FenwickTree< T, Op, Alloc >::_prefix_sum_lanes ( const int* rights, T* results, size_t count ) const {
+    const T* tree = this->data();
+    size_t query = 0;
+
+#ifdef __AVX2__
+    // gathers and vector additions, only for sums of 32 and 64 bit integers
+    constexpr bool integer_sum = std::is_integral< T >::value && std::is_same< Op, FenwickSum< T > >::value;
+    if constexpr ( integer_sum && sizeof( T ) == 4 ) {
+        const __m256i one = _mm256_set1_epi32( 1 );
+        const __m256i minus_one = _mm256_set1_epi32( -1 );
+        for ( ; query + 8 <= count; query += 8 ) {
+            __m256i index = _mm256_loadu_si256( ( const __m256i* )( rights + query ) );
+            __m256i active = _mm256_cmpgt_epi32( index, minus_one );
+            __m256i result = _mm256_setzero_si256();
+            while ( !_mm256_testz_si256( active, active ) ) {
+                result = _mm256_add_epi32( result, _mm256_mask_i32gather_epi32(
+                        _mm256_setzero_si256(), ( const int* )tree, index, active, 4 ) );
+                index = _mm256_sub_epi32( _mm256_and_si256( index, _mm256_add_epi32( index, one ) ), one );
+                active = _mm256_cmpgt_epi32( index, minus_one );
+            }
+            _mm256_storeu_si256( ( __m256i* )( results + query ), result );
+        }
+    } else if constexpr ( integer_sum && sizeof( T ) == 8 ) {
+        const __m128i one = _mm_set1_epi32( 1 );
+        const __m128i minus_one = _mm_set1_epi32( -1 );
+        for ( ; query + 4 <= count; query += 4 ) {
+            __m128i index = _mm_loadu_si128( ( const __m128i* )( rights + query ) );
+            __m128i active = _mm_cmpgt_epi32( index, minus_one );
+            __m256i result = _mm256_setzero_si256();
+            while ( !_mm_testz_si128( active, active ) ) {
+                result = _mm256_add_epi64( result, _mm256_mask_i32gather_epi64(
+                        _mm256_setzero_si256(), ( const long long* )tree, index,
+                        _mm256_cvtepi32_epi64( active ), 8 ) );
+                index = _mm_sub_epi32( _mm_and_si128( index, _mm_add_epi32( index, one ) ), one );
+                active = _mm_cmpgt_epi32( index, minus_one );
+            }
+            _mm256_storeu_si256( ( __m256i* )( results + query ), result );
+        }
+    }
+#endif
+
+    // generic path: several independent walks interleaved, so their loads overlap
+    for ( ; query < count; query += _batch_lanes ) {
+        size_t lanes = std::min( _batch_lanes, count - query );
+        int index[_batch_lanes];
+        T result[_batch_lanes];
+        for ( size_t lane = 0; lane < lanes; lane++ ) {
+            index[lane] = rights[query + lane];
+            result[lane] = Op::identity();
+        }
+
+        bool active = true;
+        while ( active ) {
+            active = false;
+            for ( size_t lane = 0; lane < lanes; lane++ ) {
+                if ( index[lane] >= 0 ) {
+                    result[lane] = Op::combine( result[lane], tree[index[lane]] );
+                    index[lane] = (index[lane] & (index[lane] + 1)) - 1;
+                    active = true;
+                }
+            }
+        }
+
+        for ( size_t lane = 0; lane < lanes; lane++ )
+            results[query + lane] = result[lane];
+    }
+}
+
+template< typename T, typename Op, typename Alloc >
+void FenwickTree< T, Op, Alloc >::inc_batch ( const std::vector< int >& indices, const std::vector< T >& deltas ) {
+    if ( indices.size() != deltas.size() )
+        throw std::logic_error( "inc_batch:: Number of indices must be equal to number of deltas" );
+    for ( int index : indices )
+        if ( index < 0 || index >= ( int )this->size() )
+            throw std::range_error( "inc_batch:: Index must be greater then zero and less then size of tree" );
+
+    size_t depth = 1;
+    while ( ( size_t( 1 ) << depth ) <= this->size() )
+        depth++;
+
+    if ( indices.size() * depth < this->size() ) {
+        for ( size_t i = 0; i < indices.size(); i++ )
+            for ( int index = indices[i]; index < ( int )this->size(); index = (index | (index + 1)) )
+                _storage::operator[]( index ) = Op::combine( _storage::operator[]( index ), deltas[i] );
+    } else {
+        // a node combines its range, so combining the tree of deltas node by node applies them all;
+        // the tree of deltas is built in O(n)
+        _storage tree_of_deltas( this->size(), Op::identity() );
+        for ( size_t i = 0; i < indices.size(); i++ )
+            tree_of_deltas[indices[i]] = Op::combine( tree_of_deltas[indices[i]], deltas[i] );
+        _build( tree_of_deltas );
+        for ( size_t i = 0; i < this->size(); i++ )
+            _storage::operator[]( i ) = Op::combine( _storage::operator[]( i ), tree_of_deltas[i] );
+    }
+}
+
+template< typename T, typename Op, typename Alloc >
+void FenwickTree< T, Op, Alloc >::sum_batch ( const std::vector< std::pair< int, int > >& ranges, std::vector< T >& out ) const {
+    static_assert( Op::invertible, "sum_batch:: operation is not invertible" );
+    std::vector< int > borders( 2 * ranges.size() );
+    for ( size_t i = 0; i < ranges.size(); i++ ) {
+        int left = std::min( ranges[i].first, ranges[i].second );
+        int right = std::max( ranges[i].first, ranges[i].second );
+        if ( left < 0 || right >= ( int )this->size() )
+            throw std::range_error( "sum_batch:: Index must be greater then zero and less then size of tree" );
+        borders[2 * i] = right;
+        borders[2 * i + 1] = left - 1;
+    }
+
+    std::vector< T > prefix_sums( borders.size() );
+    _prefix_sum_lanes( borders.data(), prefix_sums.data(), borders.size() );
+
+    out.resize( ranges.size() );
+    for ( size_t i = 0; i < ranges.size(); i++ )
+        out[i] = Op::inverse( prefix_sums[2 * i], prefix_sums[2 * i + 1] );
+}
+
 #endif
@@ -0,0 +1,52 @@
+#ifndef HEADER_FENWICK_TREE_ND_INCLUDED
+#define HEADER_FENWICK_TREE_ND_INCLUDED
+
+#include <iostream>
+#include <vector>
+#include <array>
+
+/*
+Многомерное дерево Фенвика - это дерево Фенвика над D-мерной решеткой, хранящееся в одном
+непрерывном массиве (построчно). Позволяет выполнять следующие операции:
+1) Изменять значение произвольного элемента за O(log^D N)
+2) Вычислять сумму на произвольном гиперпрямоугольнике за O(2^D * log^D N)
+3) Возвращать значение произвольного элемента за O(2^D * log^D N)
+Обход по измерениям разворачивается на этапе компиляции.
+*/
+
+template< typename T, size_t Dims >
+class FenwickTreeND : private std::vector< T >
+{
+	static_assert( Dims > 0, "FenwickTreeND:: number of dimensions must be positive" );
+
+public:
+	typedef std::array< int, Dims >		index_type;
+	typedef std::array< size_t, Dims >	sizes_type;
+
+private:
+	sizes_type		_sizes;
+	sizes_type		_strides;
+
+	template< size_t Dim >
+	void			_inc		( const index_type& index, size_t offset, const T& delta );
+	template< size_t Dim >
+	T				_range_sum	( const index_type& left, const index_type& right, size_t offset ) const;
+	void			_check		( const index_type& index, const char* message ) const;
+
+public:
+	// zero initialization, sizes[i] is the extent of i-th dimension
+	FenwickTreeND			( const sizes_type& sizes );
+	// increment some element
+	void			inc		( const index_type& index, const T& delta );
+	// sum over hyper-rectangle [left[0], right[0]] x ... x [left[D-1], right[D-1]]
+	T				sum		( index_type left, index_type right ) const;
+	// return element of array
+	T				operator [] ( const index_type& index ) const;
+	// set the value of element
+	void			set		( const index_type& index, const T& value );
+	// extent of some dimension
+	size_t			size	( size_t dim ) const;
+};
+
+#include "fenwick_tree_nd_methods.hpp"
+#endif
@@ -0,0 +1,87 @@
+#ifndef HEADER_FENWICK_TREE_ND_METHODS_INCLUDED
+#define HEADER_FENWICK_TREE_ND_METHODS_INCLUDED
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+
+#include "fenwick_tree_nd.hpp"
+
+template< typename T, size_t Dims >
+FenwickTreeND< T, Dims >::FenwickTreeND ( const sizes_type& sizes ) : _sizes( sizes ) {
+    size_t total = 1;
+    for ( size_t dim = Dims; dim-- > 0; ) {
+        _strides[dim] = total;
+        total *= _sizes[dim];
+    }
+    this->resize( total );
+}
+
+template< typename T, size_t Dims >
+void FenwickTreeND< T, Dims >::_check ( const index_type& index, const char* message ) const {
+    for ( size_t dim = 0; dim < Dims; dim++ )
+        if ( index[dim] < 0 || index[dim] >= ( int )_sizes[dim] )
+            throw std::range_error( message );
+}
+
+template< typename T, size_t Dims >
+template< size_t Dim >
+void FenwickTreeND< T, Dims >::_inc ( const index_type& index, size_t offset, const T& delta ) {
+    if constexpr ( Dim == Dims ) {
+        std::vector< T >::operator[]( offset ) += delta;
+    } else {
+        for ( int i = index[Dim]; i < ( int )_sizes[Dim]; i = (i | (i + 1)) )
+            _inc< Dim + 1 >( index, offset + i * _strides[Dim], delta );
+    }
+}
+
+template< typename T, size_t Dims >
+template< size_t Dim >
+T FenwickTreeND< T, Dims >::_range_sum ( const index_type& left, const index_type& right, size_t offset ) const {
+    if constexpr ( Dim == Dims ) {
+        return std::vector< T >::operator[]( offset );
+    } else {
+        T result = 0;
+        for ( int i = right[Dim]; i >= 0; i = (i & (i + 1)) - 1 )
+            result += _range_sum< Dim + 1 >( left, right, offset + i * _strides[Dim] );
+        for ( int i = left[Dim] - 1; i >= 0; i = (i & (i + 1)) - 1 )
+            result -= _range_sum< Dim + 1 >( left, right, offset + i * _strides[Dim] );
+        return result;
+    }
+}
+
+template< typename T, size_t Dims >
+void FenwickTreeND< T, Dims >::inc ( const index_type& index, const T& delta ) {
+    _check( index, "inc:: Index must be greater then zero and less then size of tree" );
+    _inc< 0 >( index, 0, delta );
+}
+
+template< typename T, size_t Dims >
+T FenwickTreeND< T, Dims >::sum ( index_type left, index_type right ) const {
+    for ( size_t dim = 0; dim < Dims; dim++ )
+        if ( left[dim] > right[dim] )
+            std::swap( left[dim], right[dim] );
+    _check( left, "sum:: Index must be greater then zero and less then size of tree" );
+    _check( right, "sum:: Index must be greater then zero and less then size of tree" );
+
+    return _range_sum< 0 >( left, right, 0 );
+}
+
+template< typename T, size_t Dims >
+T FenwickTreeND< T, Dims >::operator [] ( const index_type& index ) const {
+    return sum( index, index );
+}
+
+template< typename T, size_t Dims >
+void FenwickTreeND< T, Dims >::set ( const index_type& index, const T& value ) {
+    _check( index, "set:: Index must be greater then zero and less then size of tree" );
+
+    T delta = value - sum( index, index );
+    _inc< 0 >( index, 0, delta );
+}
+
+template< typename T, size_t Dims >
+size_t FenwickTreeND< T, Dims >::size ( size_t dim ) const {
+    return _sizes.at( dim );
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef HEADER_HUGE_PAGE_ALLOCATOR_INCLUDED
+#define HEADER_HUGE_PAGE_ALLOCATOR_INCLUDED
+
+#include <cstddef>
+#include <new>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+/*
+Аллокатор для больших массивов: блоки от 2 МБ выделяются через mmap и помечаются
+madvise(MADV_HUGEPAGE), чтобы ядро отдавало их страницами по 2 МБ и случайные обращения
+к массиву реже промахивались мимо TLB. Небольшие блоки выделяются обычным operator new
+с выравниванием типа, страницы mmap выровнены на 4 КБ.
+На системах без mmap всегда используется operator new.
+*/
+
+template< typename T >
+class HugePageAllocator
+{
+public:
+	typedef T value_type;
+
+	static constexpr size_t huge_page_size = size_t( 1 ) << 21;
+
+	HugePageAllocator		() noexcept {}
+	template< typename U >
+	HugePageAllocator		( const HugePageAllocator< U >& ) noexcept {}
+
+	T*				allocate	( size_t n );
+	void			deallocate	( T* pointer, size_t n ) noexcept;
+};
+
+template< typename T >
+T* HugePageAllocator< T >::allocate ( size_t n ) {
+    size_t bytes = n * sizeof( T );
+#ifdef __linux__
+    if ( bytes >= huge_page_size ) {
+        bytes = ( bytes + huge_page_size - 1 ) / huge_page_size * huge_page_size;
+        void* pointer = mmap( NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if ( pointer == MAP_FAILED )
+            throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        madvise( pointer, bytes, MADV_HUGEPAGE );
+#endif
+        return static_cast< T* >( pointer );
+    }
+#endif
+    if ( alignof( T ) > __STDCPP_DEFAULT_NEW_ALIGNMENT__ )
+        return static_cast< T* >( ::operator new( bytes, std::align_val_t( alignof( T ) ) ) );
+    return static_cast< T* >( ::operator new( bytes ) );
+}
+
+template< typename T >
+void HugePageAllocator< T >::deallocate ( T* pointer, size_t n ) noexcept {
+    size_t bytes = n * sizeof( T );
+#ifdef __linux__
+    if ( bytes >= huge_page_size ) {
+        bytes = ( bytes + huge_page_size - 1 ) / huge_page_size * huge_page_size;
+        munmap( pointer, bytes );
+        return;
+    }
+#endif
+    if ( alignof( T ) > __STDCPP_DEFAULT_NEW_ALIGNMENT__ )
+        ::operator delete( pointer, std::align_val_t( alignof( T ) ) );
+    else
+        ::operator delete( pointer );
+}
+
+template< typename T, typename U >
+bool operator == ( const HugePageAllocator< T >&, const HugePageAllocator< U >& ) {
+    return true;
+}
+
+template< typename T, typename U >
+bool operator != ( const HugePageAllocator< T >&, const HugePageAllocator< U >& ) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef HEADER_MAPPED_FENWICK_TREE_INCLUDED
+#define HEADER_MAPPED_FENWICK_TREE_INCLUDED
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <type_traits>
+
+/*
+Дерево Фенвика, массив которого лежит в файле, отображенном в память (mmap, MAP_SHARED).
+Файл начинается с заголовка (сигнатура, версия, размер и вид элемента, число элементов),
+за ним с выравниванием по кэш-линии идет массив дерева в том же виде, что и у FenwickTree.
+Открытие существующего файла занимает O(1): дерево не перестраивается, страницы
+подгружаются по мере обращения. sync() сбрасывает изменения на диск (контрольная точка).
+Файл переносим только между машинами с одинаковым порядком байт.
+*/
+
+struct _MappedFenwickHeader
+{
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	element_size;
+	uint32_t	element_kind;
+	uint32_t	reserved;
+	uint64_t	size;
+};
+
+template< typename T >
+class MappedFenwickTree
+{
+	static_assert( std::is_trivially_copyable< T >::value, "MappedFenwickTree:: T must be trivially copyable" );
+
+private:
+	static constexpr size_t _data_offset = 64;
+	static constexpr uint32_t _version = 1;
+
+	int			_file;
+	char*		_mapping;
+	size_t		_mapping_size;
+	T*			_tree;
+	size_t		_size;
+
+	static uint32_t	_element_kind	();
+	void		_create		( const std::string& path, size_t size );
+	T			_prefix_sum	( int right ) const;
+	T			_point_value	( int index ) const;
+
+public:
+    // create file with zero initialized tree, existing file is overwritten
+    MappedFenwickTree		( const std::string& path, size_t size );
+    // create file with tree built from vector in O(n)
+    MappedFenwickTree		( const std::string& path, const std::vector< T >& );
+    // open existing file in O(1)
+    explicit MappedFenwickTree	( const std::string& path );
+    ~MappedFenwickTree		();
+
+    MappedFenwickTree		( const MappedFenwickTree& ) = delete;
+    MappedFenwickTree& operator = ( const MappedFenwickTree& ) = delete;
+
+    // increment some element
+    void            inc     ( int index, const T& delta );
+    // sum of subarray
+    T               sum     ( int left, int right ) const;
+    // return element of array
+    T               operator [] ( size_t index ) const;
+    // set the value of element
+    void            set     ( size_t index, const T& value );
+    // number of elements
+    size_t          size    () const;
+    // write dirty pages to the file and wait for completion
+    void            sync    ();
+};
+
+#include "mapped_fenwick_tree_methods.hpp"
+#endif
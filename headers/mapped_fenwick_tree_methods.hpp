@@ -0,0 +1,178 @@
+#ifndef HEADER_MAPPED_FENWICK_TREE_METHODS_INCLUDED
+#define HEADER_MAPPED_FENWICK_TREE_METHODS_INCLUDED
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapped_fenwick_tree.hpp"
+
+static const char _mapped_fenwick_magic[8] = { 'F', 'E', 'N', 'W', 'I', 'C', 'K', '\0' };
+
+template< typename T >
+uint32_t MappedFenwickTree< T >::_element_kind () {
+    if ( std::is_floating_point< T >::value )
+        return 2;
+    return std::is_signed< T >::value ? 0 : 1;
+}
+
+template< typename T >
+void MappedFenwickTree< T >::_create ( const std::string& path, size_t size ) {
+    _file = open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+    if ( _file < 0 )
+        throw std::runtime_error( "MappedFenwickTree:: can not create " + path );
+
+    _size = size;
+    _mapping_size = _data_offset + size * sizeof( T );
+    if ( ftruncate( _file, _mapping_size ) != 0 ) {
+        close( _file );
+        throw std::runtime_error( "MappedFenwickTree:: can not resize " + path );
+    }
+
+    void* mapping = mmap( NULL, _mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, _file, 0 );
+    if ( mapping == MAP_FAILED ) {
+        close( _file );
+        throw std::runtime_error( "MappedFenwickTree:: can not map " + path );
+    }
+    _mapping = static_cast< char* >( mapping );
+    _tree = reinterpret_cast< T* >( _mapping + _data_offset );
+
+    _MappedFenwickHeader header;
+    std::memset( &header, 0, sizeof( header ) );
+    std::memcpy( header.magic, _mapped_fenwick_magic, sizeof( header.magic ) );
+    header.version = _version;
+    header.element_size = sizeof( T );
+    header.element_kind = _element_kind();
+    header.size = size;
+    std::memcpy( _mapping, &header, sizeof( header ) );
+}
+
+template< typename T >
+MappedFenwickTree< T >::MappedFenwickTree ( const std::string& path, size_t size ) {
+    // ftruncate fills the file with zeros, which is a zero tree
+    _create( path, size );
+}
+
+template< typename T >
+MappedFenwickTree< T >::MappedFenwickTree ( const std::string& path, const std::vector< T >& array ) {
+    _create( path, array.size() );
+    std::copy( array.begin(), array.end(), _tree );
+    for ( size_t i = 0; i < _size; i++ ) {
+        size_t parent = i | (i + 1);
+        if ( parent < _size )
+            _tree[parent] += _tree[i];
+    }
+}
+
+template< typename T >
+MappedFenwickTree< T >::MappedFenwickTree ( const std::string& path ) {
+    _file = open( path.c_str(), O_RDWR );
+    if ( _file < 0 )
+        throw std::runtime_error( "MappedFenwickTree:: can not open " + path );
+
+    struct stat file_stat;
+    _MappedFenwickHeader header;
+    if ( fstat( _file, &file_stat ) != 0 || ( size_t )file_stat.st_size < _data_offset ||
+         pread( _file, &header, sizeof( header ), 0 ) != ( ssize_t )sizeof( header ) ) {
+        close( _file );
+        throw std::runtime_error( "MappedFenwickTree:: " + path + " is not a tree file" );
+    }
+    if ( std::memcmp( header.magic, _mapped_fenwick_magic, sizeof( header.magic ) ) != 0 ||
+         header.version != _version ) {
+        close( _file );
+        throw std::runtime_error( "MappedFenwickTree:: " + path + " has unknown format" );
+    }
+    if ( header.element_size != sizeof( T ) || header.element_kind != _element_kind() ||
+         ( size_t )file_stat.st_size != _data_offset + header.size * sizeof( T ) ) {
+        close( _file );
+        throw std::runtime_error( "MappedFenwickTree:: " + path + " stores another element type" );
+    }
+
+    _size = header.size;
+    _mapping_size = file_stat.st_size;
+    void* mapping = mmap( NULL, _mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, _file, 0 );
+    if ( mapping == MAP_FAILED ) {
+        close( _file );
+        throw std::runtime_error( "MappedFenwickTree:: can not map " + path );
+    }
+    _mapping = static_cast< char* >( mapping );
+    _tree = reinterpret_cast< T* >( _mapping + _data_offset );
+}
+
+template< typename T >
+MappedFenwickTree< T >::~MappedFenwickTree () {
+    munmap( _mapping, _mapping_size );
+    close( _file );
+}
+
+template< typename T >
+void MappedFenwickTree< T >::inc ( int index, const T& delta ) {
+    if ( index < 0 || index >= ( int )_size )
+        throw std::range_error( "inc:: Index must be greater then zero and less then size of tree" );
+
+    for ( ; index < ( int )_size; index = (index | (index + 1)) )
+        _tree[index] += delta;
+}
+
+template< typename T >
+T MappedFenwickTree< T >::_prefix_sum ( int right ) const {
+    T result = 0;
+    for ( ; right >= 0; right = (right & (right + 1)) - 1 )
+        result += _tree[right];
+    return result;
+}
+
+template< typename T >
+T MappedFenwickTree< T >::_point_value ( int index ) const {
+    T result = _tree[index];
+    int stop = (index & (index + 1)) - 1;
+    for ( int child = index - 1; child != stop; child = (child & (child + 1)) - 1 )
+        result -= _tree[child];
+    return result;
+}
+
+template< typename T >
+T MappedFenwickTree< T >::sum ( int left, int right ) const {
+    if ( left > right )
+        std::swap( left, right );
+    if ( left < 0 || right >= ( int )_size )
+        throw std::range_error( "sum:: Index must be greater then zero and less then size of tree" );
+
+    return _prefix_sum( right ) - _prefix_sum( left - 1 );
+}
+
+template< typename T >
+T MappedFenwickTree< T >::operator [] ( size_t index ) const {
+    if ( index >= _size )
+        throw std::range_error( "opeartor[]:: Index must be greater then zero and less then size of tree" );
+    return _point_value( index );
+}
+
+template< typename T >
+void MappedFenwickTree< T >::set ( size_t index, const T& value ) {
+    if ( index >= _size )
+        throw std::range_error( "set:: Index must be greater then zero and less then size of tree" );
+
+    T delta = value - _point_value( index );
+    inc( index, delta );
+}
+
+template< typename T >
+size_t MappedFenwickTree< T >::size () const {
+    return _size;
+}
+
+template< typename T >
+void MappedFenwickTree< T >::sync () {
+    if ( msync( _mapping, _mapping_size, MS_SYNC ) != 0 )
+        throw std::runtime_error( "MappedFenwickTree:: msync failed" );
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef HEADER_SEGMENT_TREE_INCLUDED
+#define HEADER_SEGMENT_TREE_INCLUDED
+
+#include <iostream>
+#include <vector>
+#include <optional>
+#include <type_traits>
+
+#include "fenwick_tree.hpp"
+
+/*
+Дерево отрезков с отложенными операциями. Узлы хранятся в плоском массиве размера 2 * 2^k
+(корень - 1, дети узла i - 2i и 2i + 1, листья - начиная с 2^k), все операции выполняются
+снизу вверх без рекурсии. В отличие от FenwickTree позволяет:
+1) Вычислять на отрезке необратимые операции (минимум, максимум) за O(log N)
+2) Применять к отрезку отложенную операцию (прибавление, присваивание) за O(log N)
+3) max_right - двоичный поиск по отрезкам, начинающимся с left, за O(log N)
+Monoid - операция над элементами, как в FenwickTree (FenwickSum, FenwickXor, FenwickMax,
+FenwickMin или своя с identity() и combine()).
+Lazy - отложенная операция: тип метки tag_type, identity(), compose( новая, старая ) и
+apply< Monoid >( метка, значение узла, длина отрезка узла ).
+*/
+
+/*
+Прибавление ко всем элементам отрезка. Для суммы значение узла растет на delta * длина,
+для минимума и максимума - на delta.
+*/
+template< typename T >
+struct SegmentAdd {
+    using tag_type = T;
+    static tag_type identity () { return T( 0 ); }
+    static tag_type compose ( const tag_type& newer, const tag_type& older ) { return newer + older; }
+    template< typename Monoid >
+    static T apply ( const tag_type& tag, const T& value, size_t length );
+};
+
+/*
+Присваивание всем элементам отрезка. Пустая метка - нет отложенного присваивания.
+*/
+template< typename T >
+struct SegmentAssign {
+    using tag_type = std::optional< T >;
+    static tag_type identity () { return std::nullopt; }
+    static tag_type compose ( const tag_type& newer, const tag_type& older ) { return newer ? newer : older; }
+    template< typename Monoid >
+    static T apply ( const tag_type& tag, const T& value, size_t length );
+};
+
+template< typename T, typename Monoid = FenwickSum< T >, typename Lazy = SegmentAdd< T > >
+class SegmentTree
+{
+public:
+    using tag_type = typename Lazy::tag_type;
+
+private:
+	size_t					_count;
+	size_t					_leaves;
+	int						_height;
+	std::vector< T >		_data;
+	// pending operation of every inner node, already applied to the node itself
+	std::vector< tag_type >	_lazy;
+
+	size_t		_length		( size_t node ) const;
+	void		_update		( size_t node );
+	void		_apply_node	( size_t node, const tag_type& tag );
+	void		_push		( size_t node );
+	// pushes the tags on the paths to the borders of [left, right)
+	void		_push_borders	( size_t left, size_t right );
+	void		_init		( size_t size );
+
+public:
+    // all elements equal to value
+    SegmentTree             ( size_t size, const T& value = T() );
+    // initialization from vector, O(n)
+    SegmentTree             ( const std::vector< T >& );
+    // combination of elements [left, right]
+    T               query   ( size_t left, size_t right );
+    // apply operation to elements [left, right]
+    void            apply   ( size_t left, size_t right, const tag_type& tag );
+    // set the value of element
+    void            set     ( size_t index, const T& value );
+    // return element of array
+    T               operator [] ( size_t index );
+    // first right >= left such that pred( query( left, right ) ) is false, size() if there is none;
+    // pred must hold for the identity and stay false once it fails
+    template< typename Pred >
+    size_t          max_right   ( size_t left, Pred pred );
+    size_t          size    () const;
+};
+
+#include "segment_tree_methods.hpp"
+#endif
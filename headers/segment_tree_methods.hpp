@@ -0,0 +1,213 @@
+#ifndef HEADER_SEGMENT_TREE_METHODS_INCLUDED
+#define HEADER_SEGMENT_TREE_METHODS_INCLUDED
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
+
+#include "segment_tree.hpp"
+
+template< typename T >
+template< typename Monoid >
+T SegmentAdd< T >::apply ( const tag_type& tag, const T& value, size_t length ) {
+    if constexpr ( std::is_same< Monoid, FenwickSum< T > >::value ) {
+        return value + tag * T( length );
+    } else {
+        static_assert( std::is_same< Monoid, FenwickMin< T > >::value || std::is_same< Monoid, FenwickMax< T > >::value,
+                       "SegmentAdd:: supports sum, min and max" );
+        return value + tag;
+    }
+}
+
+template< typename T >
+template< typename Monoid >
+T SegmentAssign< T >::apply ( const tag_type& tag, const T& value, size_t length ) {
+    if ( !tag )
+        return value;
+    if constexpr ( std::is_same< Monoid, FenwickSum< T > >::value ) {
+        return *tag * T( length );
+    } else if constexpr ( std::is_same< Monoid, FenwickXor< T > >::value ) {
+        return length % 2 == 1 ? *tag : T( 0 );
+    } else {
+        // any idempotent operation: min, max, gcd, bitwise and/or
+        return *tag;
+    }
+}
+
+template< typename T, typename Monoid, typename Lazy >
+void SegmentTree< T, Monoid, Lazy >::_init ( size_t size ) {
+    _count = size;
+    _leaves = 1;
+    _height = 0;
+    while ( _leaves < size ) {
+        _leaves <<= 1;
+        _height++;
+    }
+    // leaves past the end hold the identity and never receive tags
+    _data.assign( 2 * _leaves, Monoid::identity() );
+    _lazy.assign( _leaves, Lazy::identity() );
+}
+
+template< typename T, typename Monoid, typename Lazy >
+SegmentTree< T, Monoid, Lazy >::SegmentTree ( size_t size, const T& value ) {
+    _init( size );
+    std::fill( _data.begin() + _leaves, _data.begin() + _leaves + size, value );
+    for ( size_t node = _leaves - 1; node >= 1; node-- )
+        _update( node );
+}
+
+template< typename T, typename Monoid, typename Lazy >
+SegmentTree< T, Monoid, Lazy >::SegmentTree ( const std::vector< T >& array ) {
+    _init( array.size() );
+    std::copy( array.begin(), array.end(), _data.begin() + _leaves );
+    for ( size_t node = _leaves - 1; node >= 1; node-- )
+        _update( node );
+}
+
+template< typename T, typename Monoid, typename Lazy >
+size_t SegmentTree< T, Monoid, Lazy >::_length ( size_t node ) const {
+    // node at depth d covers 2^(height - d) leaves
+    return _leaves >> ( 63 - __builtin_clzll( node ) );
+}
+
+template< typename T, typename Monoid, typename Lazy >
+void SegmentTree< T, Monoid, Lazy >::_update ( size_t node ) {
+    _data[node] = Monoid::combine( _data[2 * node], _data[2 * node + 1] );
+}
+
+template< typename T, typename Monoid, typename Lazy >
+void SegmentTree< T, Monoid, Lazy >::_apply_node ( size_t node, const tag_type& tag ) {
+    _data[node] = Lazy::template apply< Monoid >( tag, _data[node], _length( node ) );
+    if ( node < _leaves )
+        _lazy[node] = Lazy::compose( tag, _lazy[node] );
+}
+
+template< typename T, typename Monoid, typename Lazy >
+void SegmentTree< T, Monoid, Lazy >::_push ( size_t node ) {
+    _apply_node( 2 * node, _lazy[node] );
+    _apply_node( 2 * node + 1, _lazy[node] );
+    _lazy[node] = Lazy::identity();
+}
+
+template< typename T, typename Monoid, typename Lazy >
+void SegmentTree< T, Monoid, Lazy >::_push_borders ( size_t left, size_t right ) {
+    // only the ancestors of partially covered nodes can hold tags the answer depends on
+    for ( int level = _height; level >= 1; level-- ) {
+        if ( ( ( left >> level ) << level ) != left )
+            _push( left >> level );
+        if ( ( ( right >> level ) << level ) != right )
+            _push( ( right - 1 ) >> level );
+    }
+}
+
+template< typename T, typename Monoid, typename Lazy >
+T SegmentTree< T, Monoid, Lazy >::query ( size_t left, size_t right ) {
+    if ( left > right )
+        std::swap( left, right );
+    if ( right >= _count )
+        throw std::range_error( "query:: Index must be less then size of tree" );
+
+    left += _leaves;
+    right += _leaves + 1;
+    _push_borders( left, right );
+    T result_left = Monoid::identity(), result_right = Monoid::identity();
+    for ( ; left < right; left >>= 1, right >>= 1 ) {
+        if ( left & 1 )
+            result_left = Monoid::combine( result_left, _data[left++] );
+        if ( right & 1 )
+            result_right = Monoid::combine( _data[--right], result_right );
+    }
+    return Monoid::combine( result_left, result_right );
+}
+
+template< typename T, typename Monoid, typename Lazy >
+void SegmentTree< T, Monoid, Lazy >::apply ( size_t left, size_t right, const tag_type& tag ) {
+    if ( left > right )
+        std::swap( left, right );
+    if ( right >= _count )
+        throw std::range_error( "apply:: Index must be less then size of tree" );
+
+    left += _leaves;
+    right += _leaves + 1;
+    _push_borders( left, right );
+    for ( size_t l = left, r = right; l < r; l >>= 1, r >>= 1 ) {
+        if ( l & 1 )
+            _apply_node( l++, tag );
+        if ( r & 1 )
+            _apply_node( --r, tag );
+    }
+    for ( int level = 1; level <= _height; level++ ) {
+        if ( ( ( left >> level ) << level ) != left )
+            _update( left >> level );
+        if ( ( ( right >> level ) << level ) != right )
+            _update( ( right - 1 ) >> level );
+    }
+}
+
+template< typename T, typename Monoid, typename Lazy >
+void SegmentTree< T, Monoid, Lazy >::set ( size_t index, const T& value ) {
+    if ( index >= _count )
+        throw std::range_error( "set:: Index must be less then size of tree" );
+
+    index += _leaves;
+    for ( int level = _height; level >= 1; level-- )
+        _push( index >> level );
+    _data[index] = value;
+    for ( int level = 1; level <= _height; level++ )
+        _update( index >> level );
+}
+
+template< typename T, typename Monoid, typename Lazy >
+T SegmentTree< T, Monoid, Lazy >::operator [] ( size_t index ) {
+    if ( index >= _count )
+        throw std::range_error( "operator[]:: Index must be less then size of tree" );
+
+    index += _leaves;
+    for ( int level = _height; level >= 1; level-- )
+        _push( index >> level );
+    return _data[index];
+}
+
+template< typename T, typename Monoid, typename Lazy >
+template< typename Pred >
+size_t SegmentTree< T, Monoid, Lazy >::max_right ( size_t left, Pred pred ) {
+    if ( left > _count )
+        throw std::range_error( "max_right:: Index must be not greater then size of tree" );
+    if ( left == _count )
+        return _count;
+
+    size_t node = left + _leaves;
+    for ( int level = _height; level >= 1; level-- )
+        _push( node >> level );
+    T accumulated = Monoid::identity();
+    do {
+        // climb while node is a left child: its parent covers the same start
+        while ( node % 2 == 0 )
+            node >>= 1;
+        T next = Monoid::combine( accumulated, _data[node] );
+        if ( !pred( next ) ) {
+            // the answer is inside node, descend to the first leaf that breaks pred
+            while ( node < _leaves ) {
+                _push( node );
+                node = 2 * node;
+                next = Monoid::combine( accumulated, _data[node] );
+                if ( pred( next ) ) {
+                    accumulated = next;
+                    node++;
+                }
+            }
+            return std::min( node - _leaves, _count );
+        }
+        accumulated = next;
+        node++;
+    } while ( ( node & ( ~node + 1 ) ) != node );
+    return _count;
+}
+
+template< typename T, typename Monoid, typename Lazy >
+size_t SegmentTree< T, Monoid, Lazy >::size () const {
+    return _count;
+}
+
+#endif
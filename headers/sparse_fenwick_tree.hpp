@@ -0,0 +1,55 @@
+#ifndef HEADER_SPARSE_FENWICK_TREE_INCLUDED
+#define HEADER_SPARSE_FENWICK_TREE_INCLUDED
+
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+/*
+Разреженное дерево Фенвика над 64-битными индексами. Узлы хранятся в хеш-таблице с открытой
+адресацией (линейное пробирование), узел создается только при первом изменении, поэтому память
+пропорциональна числу изменений, умноженному на log(размера диапазона), а не самому диапазону.
+Отсутствующий узел равен нулю. Операции:
+1) inc и sum за O(log N) обращений к таблице
+2) lower_bound - первый индекс, префиксная сумма до которого не меньше заданной, за O(log N)
+   (элементы должны быть неотрицательными)
+*/
+
+template< typename T >
+class SparseFenwickTree
+{
+private:
+	// slots with key zero are empty, node keys are 1-based
+	std::vector< std::pair< uint64_t, T > >	_slots;
+	size_t		_nodes;
+	uint64_t	_size;
+
+	size_t		_slot		( uint64_t key ) const;
+	const T*	_find		( uint64_t key ) const;
+	T&			_node		( uint64_t key );
+	void		_rehash		( size_t capacity );
+	T			_prefix_sum	( uint64_t count ) const;
+
+public:
+    // elements [0, size), all zero; the largest size is 2^64 - 1
+    explicit SparseFenwickTree	( uint64_t size = std::numeric_limits< uint64_t >::max() );
+    // increment some element
+    void            inc         ( uint64_t index, const T& delta );
+    // sum of subarray
+    T               sum         ( uint64_t left, uint64_t right ) const;
+    // return element of array
+    T               operator [] ( uint64_t index ) const;
+    // first index whose prefix sum is not less than value, size() if there is none
+    uint64_t        lower_bound ( const T& value ) const;
+    uint64_t        size        () const;
+    // number of stored nodes
+    size_t          nodes       () const;
+    // room for the given number of nodes without rehashing
+    void            reserve     ( size_t nodes );
+    void            clear       ();
+};
+
+#include "sparse_fenwick_tree_methods.hpp"
+#endif
@@ -0,0 +1,147 @@
+#ifndef HEADER_SPARSE_FENWICK_TREE_METHODS_INCLUDED
+#define HEADER_SPARSE_FENWICK_TREE_METHODS_INCLUDED
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+
+#include "sparse_fenwick_tree.hpp"
+
+template< typename T >
+SparseFenwickTree< T >::SparseFenwickTree ( uint64_t size ) : _slots( 16, { 0, T( 0 ) } ), _nodes( 0 ), _size( size ) {
+}
+
+template< typename T >
+size_t SparseFenwickTree< T >::_slot ( uint64_t key ) const {
+    // Fibonacci hashing: the high bits of the product are well mixed
+    int shift = 64;
+    for ( size_t capacity = _slots.size(); capacity > 1; capacity >>= 1 )
+        shift--;
+    return ( key * 0x9E3779B97F4A7C15ull ) >> shift;
+}
+
+template< typename T >
+const T* SparseFenwickTree< T >::_find ( uint64_t key ) const {
+    size_t mask = _slots.size() - 1;
+    for ( size_t slot = _slot( key ); _slots[slot].first != 0; slot = (slot + 1) & mask )
+        if ( _slots[slot].first == key )
+            return &_slots[slot].second;
+    return nullptr;
+}
+
+template< typename T >
+T& SparseFenwickTree< T >::_node ( uint64_t key ) {
+    // load factor is kept at most 1/2, so probe sequences stay short
+    if ( 2 * ( _nodes + 1 ) > _slots.size() )
+        _rehash( 2 * _slots.size() );
+    size_t mask = _slots.size() - 1;
+    size_t slot = _slot( key );
+    for ( ; _slots[slot].first != 0; slot = (slot + 1) & mask )
+        if ( _slots[slot].first == key )
+            return _slots[slot].second;
+    _nodes++;
+    _slots[slot].first = key;
+    return _slots[slot].second;
+}
+
+template< typename T >
+void SparseFenwickTree< T >::_rehash ( size_t capacity ) {
+    std::vector< std::pair< uint64_t, T > > old( capacity, { 0, T( 0 ) } );
+    old.swap( _slots );
+    size_t mask = _slots.size() - 1;
+    for ( auto& entry : old ) {
+        if ( entry.first == 0 )
+            continue;
+        size_t slot = _slot( entry.first );
+        while ( _slots[slot].first != 0 )
+            slot = (slot + 1) & mask;
+        _slots[slot] = std::move( entry );
+    }
+}
+
+template< typename T >
+void SparseFenwickTree< T >::inc ( uint64_t index, const T& delta ) {
+    if ( index >= _size )
+        throw std::range_error( "inc:: Index must be less then size of tree" );
+
+    // node key covers elements (key - lowbit(key), key], keys past 2^64 - 1 wrap to zero
+    for ( uint64_t key = index + 1; key != 0 && key <= _size; key += key & (~key + 1) )
+        _node( key ) += delta;
+}
+
+template< typename T >
+T SparseFenwickTree< T >::_prefix_sum ( uint64_t count ) const {
+    T result = T( 0 );
+    for ( uint64_t key = count; key != 0; key &= key - 1 ) {
+        const T* node = _find( key );
+        if ( node != nullptr )
+            result += *node;
+    }
+    return result;
+}
+
+template< typename T >
+T SparseFenwickTree< T >::sum ( uint64_t left, uint64_t right ) const {
+    if ( left > right )
+        std::swap( left, right );
+    if ( right >= _size )
+        throw std::range_error( "sum:: Index must be less then size of tree" );
+
+    return _prefix_sum( right + 1 ) - _prefix_sum( left );
+}
+
+template< typename T >
+T SparseFenwickTree< T >::operator [] ( uint64_t index ) const {
+    return sum( index, index );
+}
+
+template< typename T >
+uint64_t SparseFenwickTree< T >::lower_bound ( const T& value ) const {
+    if ( !( T( 0 ) < value ) )
+        return 0;
+    // binary lifting: take every node whose sum keeps the prefix below value
+    uint64_t position = 0;
+    T prefix = T( 0 );
+    uint64_t step = uint64_t( 1 ) << 63;
+    while ( step > _size )
+        step >>= 1;
+    for ( ; step != 0; step >>= 1 ) {
+        if ( position + step > _size )
+            continue;
+        const T* node = _find( position + step );
+        T next = node == nullptr ? prefix : prefix + *node;
+        if ( next < value ) {
+            position += step;
+            prefix = next;
+        }
+    }
+    // position elements have a prefix sum below value, so the answer is the next index
+    return position;
+}
+
+template< typename T >
+uint64_t SparseFenwickTree< T >::size () const {
+    return _size;
+}
+
+template< typename T >
+size_t SparseFenwickTree< T >::nodes () const {
+    return _nodes;
+}
+
+template< typename T >
+void SparseFenwickTree< T >::reserve ( size_t nodes ) {
+    size_t capacity = _slots.size();
+    while ( capacity < 2 * nodes )
+        capacity *= 2;
+    if ( capacity != _slots.size() )
+        _rehash( capacity );
+}
+
+template< typename T >
+void SparseFenwickTree< T >::clear () {
+    std::vector< std::pair< uint64_t, T > >( 16, { 0, T( 0 ) } ).swap( _slots );
+    _nodes = 0;
+}
+
+#endif
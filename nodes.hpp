@@ -1,8 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <new>
 #include <iostream>
 #include <iterator>
+#include <tuple>
+#include <vector>
 
 template <typename ValueT, typename PriorityT>
 class Node;
@@ -26,6 +33,11 @@ private:
     weak_nodeptr_t<ValueT, PriorityT> parent_;
     weak_nodeptr_t<ValueT, PriorityT> my_shared_block_;
 
+    // Set once the node is cut off from its vector: it is the root of a dropped subtree or its
+    // parent was destroyed while it was still attached. Atomic because the teardown may run on the
+    // reclamation thread while a handle lookup reads it.
+    std::atomic<bool> detached_{false};
+
 public:
     using value_type = ValueT;
     using priority_type = PriorityT;
@@ -43,11 +55,45 @@ public:
             my_shared_block_(nodeptr_t<ValueT, PriorityT>(nullptr)) {
     }
 
-    Node(const Node<ValueT, PriorityT>&) = default;
-    Node(Node<ValueT, PriorityT>&&) = default;
+    Node(ValueT&& value, const PriorityT& priority)
+            :
+            value_(std::move(value)),
+            priority_(priority),
+            subtree_size_(1),
+            left_(nullptr),
+            right_(nullptr),
+            parent_(nodeptr_t<ValueT, PriorityT>(nullptr)),
+            my_shared_block_(nodeptr_t<ValueT, PriorityT>(nullptr)) {
+    }
+
+    // Nodes are linked to their own shared block, a copy would carry stale links
+    Node(const Node<ValueT, PriorityT>&) = delete;
+    Node(Node<ValueT, PriorityT>&&) = delete;
 
-    Node<ValueT, PriorityT>& operator=(const Node<ValueT, PriorityT>&) = default;
-    Node<ValueT, PriorityT>& operator=(Node<ValueT, PriorityT>&&) = default;
+    Node<ValueT, PriorityT>& operator=(const Node<ValueT, PriorityT>&) = delete;
+    Node<ValueT, PriorityT>& operator=(Node<ValueT, PriorityT>&&) = delete;
+
+    // Tears the subtree down with an explicit stack instead of a chain of nested destructors,
+    // so dropping a huge or degenerate tree cannot overflow the call stack. The outermost destructor
+    // on a thread drains the stack; a node destroyed meanwhile only pushes its children. Only nodes
+    // whose last reference is gone are touched, so children kept alive elsewhere (by an iterator or
+    // a locked handle) are merely released and marked detached, never modified.
+    ~Node() {
+        static thread_local std::vector<nodeptr_t<ValueT, PriorityT>>* pending_teardown = nullptr;
+        if (pending_teardown != nullptr) {
+            DetachChildren(*pending_teardown);
+            return;
+        }
+        std::vector<nodeptr_t<ValueT, PriorityT>> pending;
+        pending_teardown = &pending;
+        DetachChildren(pending);
+        while (!pending.empty()) {
+            auto node = std::move(pending.back());
+            pending.pop_back();
+            node.reset();
+        }
+        pending_teardown = nullptr;
+    }
 
     const ValueT& GetValue() const {
         return value_;
@@ -65,11 +111,11 @@ public:
         return subtree_size_;
     }
 
-    nodeptr_t<ValueT, PriorityT> GetLeft() const {
+    const nodeptr_t<ValueT, PriorityT>& GetLeft() const {
         return left_;
     }
 
-    nodeptr_t<ValueT, PriorityT> GetRight() const {
+    const nodeptr_t<ValueT, PriorityT>& GetRight() const {
         return right_;
     }
 
@@ -120,6 +166,27 @@ public:
         }
     }
 
+    void MarkDetached() {
+        detached_.store(true, std::memory_order_release);
+    }
+
+    bool IsDetached() const {
+        return detached_.load(std::memory_order_acquire);
+    }
+
+    // Moves the children out of a node that is being destroyed. Operations unlink a node from the
+    // tree before dropping it, so whatever it still holds belongs to a dropped subtree.
+    void DetachChildren(std::vector<nodeptr_t<ValueT, PriorityT>>& pending) {
+        if (left_ != nullptr) {
+            left_->MarkDetached();
+            pending.push_back(std::move(left_));
+        }
+        if (right_ != nullptr) {
+            right_->MarkDetached();
+            pending.push_back(std::move(right_));
+        }
+    }
+
     void UpdateUntilRoot() {
         Update();
         auto parent = parent_.lock();
@@ -146,6 +213,109 @@ MakeNodePtrT(nodeptr_t<ValueT, PriorityT> node) {
     return result;
 }
 
+// One block of memory for a known number of nodes together with their shared_ptr control blocks,
+// handed out in allocation order. Requests that do not fit go to operator new. The arena deletes
+// itself once the builder called Release and every node placed in it has been destroyed.
+class NodeArena {
+private:
+    static constexpr size_t kAlignment = 64;
+
+    char* buffer_ = nullptr;
+    size_t slot_size_ = 0;
+    size_t capacity_;
+    size_t used_ = 0;
+    // nodes placed in the arena plus one for the builder
+    std::atomic<size_t> references_{1};
+
+    ~NodeArena() {
+        if (buffer_ != nullptr) {
+            ::operator delete(buffer_, std::align_val_t(kAlignment));
+        }
+    }
+
+public:
+    explicit NodeArena(size_t capacity) : capacity_(capacity) {
+    }
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment) {
+        if (buffer_ == nullptr && capacity_ > 0 && alignment <= kAlignment) {
+            // all requests come from one allocate_shared instantiation, so the first one sizes the slots
+            slot_size_ = (size + alignment - 1) / alignment * alignment;
+            buffer_ = static_cast<char*>(::operator new(slot_size_ * capacity_, std::align_val_t(kAlignment)));
+        }
+        if (buffer_ != nullptr && size <= slot_size_ && alignment <= kAlignment && used_ < capacity_) {
+            references_.fetch_add(1, std::memory_order_relaxed);
+            return buffer_ + slot_size_ * used_++;
+        }
+        return ::operator new(size);
+    }
+
+    void Deallocate(void* pointer) {
+        char* bytes = static_cast<char*>(pointer);
+        if (buffer_ != nullptr && bytes >= buffer_ && bytes < buffer_ + slot_size_ * capacity_) {
+            Release();
+        } else {
+            ::operator delete(pointer);
+        }
+    }
+
+    void Release() {
+        if (references_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+};
+
+template <typename T>
+class NodeArenaAllocator {
+private:
+    NodeArena* arena_;
+
+public:
+    using value_type = T;
+
+    explicit NodeArenaAllocator(NodeArena* arena) : arena_(arena) {
+    }
+
+    template <typename U>
+    NodeArenaAllocator(const NodeArenaAllocator<U>& other) : arena_(other.GetArena()) {
+    }
+
+    NodeArena* GetArena() const {
+        return arena_;
+    }
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(arena_->Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* pointer, size_t) {
+        arena_->Deallocate(pointer);
+    }
+
+    template <typename U>
+    bool operator==(const NodeArenaAllocator<U>& other) const {
+        return arena_ == other.GetArena();
+    }
+
+    template <typename U>
+    bool operator!=(const NodeArenaAllocator<U>& other) const {
+        return arena_ != other.GetArena();
+    }
+};
+
+template <typename ValueT, typename PriorityT>
+nodeptr_t<ValueT, PriorityT>
+MakeArenaNodePtrT(NodeArena* arena, ValueT&& value, const PriorityT& priority) {
+    nodeptr_t<ValueT, PriorityT> result = std::allocate_shared<Node<ValueT, PriorityT>>(
+            NodeArenaAllocator<Node<ValueT, PriorityT>>(arena), std::move(value), priority);
+    result->SetMySharedBlock(result);
+    return result;
+}
+
 template <typename ValueT, typename PriorityT>
 std::ostream& operator<<(std::ostream& output_stream, const Node<ValueT, PriorityT>& node) {
     output_stream << "size: " << node.GetSubtreeSize() << ", value: " << node.GetValue()
@@ -209,17 +379,14 @@ Merge(nodeptr_t<ValueT, PriorityT> node, OtherT... other) {
 }
 
 
+// Inserts a node without children, which lets the caller keep a reference to it
 template <typename ValueT, typename PriorityT>
 nodeptr_t<ValueT, PriorityT>
-Insert(nodeptr_t<ValueT, PriorityT> node,
-       unsigned position,
-       const typename nodeptr_t<ValueT, PriorityT>::element_type::value_type& value,
-       const typename nodeptr_t<ValueT, PriorityT>::element_type::priority_type& priority) {
+Insert(nodeptr_t<ValueT, PriorityT> node, unsigned position, nodeptr_t<ValueT, PriorityT> new_node) {
     if (node == nullptr) {
-        return MakeNodePtrT<ValueT, PriorityT>(value, priority);
-    } else if (node->GetPriority() < priority) {
+        return new_node;
+    } else if (node->GetPriority() < new_node->GetPriority()) {
         auto [split_left, split_right] = Split(node, position);
-        auto new_node = MakeNodePtrT<ValueT, PriorityT>(value, priority);
         return Merge(split_left, Merge(new_node, split_right));
     } else {
         unsigned elements_before = 0;
@@ -227,15 +394,24 @@ Insert(nodeptr_t<ValueT, PriorityT> node,
             elements_before = node->GetLeft()->GetSubtreeSize();
         }
         if (position <= elements_before) {
-            node->SetLeft(Insert(node->GetLeft(), position, value, priority));
+            node->SetLeft(Insert(node->GetLeft(), position, new_node));
             return node;
         } else {
-            node->SetRight(Insert(node->GetRight(), position - 1 - elements_before, value, priority));
+            node->SetRight(Insert(node->GetRight(), position - 1 - elements_before, new_node));
             return node;
         }
     }
 }
 
+template <typename ValueT, typename PriorityT>
+nodeptr_t<ValueT, PriorityT>
+Insert(nodeptr_t<ValueT, PriorityT> node,
+       unsigned position,
+       const typename nodeptr_t<ValueT, PriorityT>::element_type::value_type& value,
+       const typename nodeptr_t<ValueT, PriorityT>::element_type::priority_type& priority) {
+    return Insert(node, position, MakeNodePtrT<ValueT, PriorityT>(value, priority));
+}
+
 
 
 template <typename ValueT, typename PriorityT>
@@ -251,7 +427,12 @@ Erase(nodeptr_t<ValueT, PriorityT> node, unsigned position) {
     }
 
     if (position == elements_before) {
-        return Merge(node->GetLeft(), node->GetRight());
+        // the erased node must not keep links into the tree, its destructor detaches its children
+        auto left = node->GetLeft();
+        auto right = node->GetRight();
+        node->SetLeft(nullptr);
+        node->SetRight(nullptr);
+        return Merge(std::move(left), std::move(right));
     } else if (elements_before > position) {
         node->SetLeft(Erase(node->GetLeft(), position));
         return node;
@@ -262,6 +443,330 @@ Erase(nodeptr_t<ValueT, PriorityT> node, unsigned position) {
 }
 
 
+template <typename ValueT, typename PriorityT>
+void
+SplitMany(nodeptr_t<ValueT, PriorityT> node, const unsigned* cuts_begin, const unsigned* cuts_end,
+          unsigned offset, std::vector<nodeptr_t<ValueT, PriorityT>>& pieces) {
+    if (cuts_begin == cuts_end) {
+        pieces.push_back(node);
+        return;
+    } else if (node == nullptr) {
+        pieces.insert(pieces.end(), cuts_end - cuts_begin + 1, nullptr);
+        return;
+    }
+
+    unsigned position = offset;
+    if (node->GetLeft() != nullptr) {
+        position += node->GetLeft()->GetSubtreeSize();
+    }
+    // cuts up to the position of the node fall into the left subtree, the rest into the right one
+    const unsigned* cuts_middle = cuts_begin;
+    while (cuts_middle != cuts_end && *cuts_middle <= position) {
+        ++cuts_middle;
+    }
+
+    SplitMany(node->GetLeft(), cuts_begin, cuts_middle, offset, pieces);
+    auto left_tail = pieces.back();
+    pieces.pop_back();
+    size_t right_head_index = pieces.size();
+    SplitMany(node->GetRight(), cuts_middle, cuts_end, position + 1, pieces);
+
+    node->SetLeft(left_tail);
+    node->SetRight(pieces[right_head_index]);
+    pieces[right_head_index] = node;
+}
+
+// Splits at sorted positions in one descent: pieces[i] holds [cuts[i - 1], cuts[i]).
+// Visits O(k log(n / k) + k) nodes for k cuts instead of k separate descents.
+template <typename ValueT, typename PriorityT>
+std::vector<nodeptr_t<ValueT, PriorityT>>
+SplitMany(nodeptr_t<ValueT, PriorityT> node, const std::vector<unsigned>& cuts) {
+    std::vector<nodeptr_t<ValueT, PriorityT>> pieces;
+    pieces.reserve(cuts.size() + 1);
+    SplitMany(node, cuts.data(), cuts.data() + cuts.size(), 0, pieces);
+    for (const auto& piece : pieces) {
+        if (piece != nullptr) {
+            piece->SetParent(nullptr);
+        }
+    }
+    return pieces;
+}
+
+// Merges pieces given in order pairwise, round by round, so every node takes part in
+// O(log k) merges: O(k log n) in total instead of O(k^2) merges of a growing tree
+template <typename ValueT, typename PriorityT>
+nodeptr_t<ValueT, PriorityT>
+MergeMany(std::vector<nodeptr_t<ValueT, PriorityT>> pieces) {
+    if (pieces.empty()) {
+        return nullptr;
+    }
+    while (pieces.size() > 1) {
+        size_t merged = 0;
+        for (size_t i = 0; i < pieces.size(); i += 2) {
+            if (i + 1 < pieces.size()) {
+                pieces[merged++] = Merge(pieces[i], pieces[i + 1]);
+            } else {
+                pieces[merged++] = pieces[i];
+            }
+        }
+        pieces.resize(merged);
+    }
+    return pieces.front();
+}
+
+// Splits a treap ordered by comp into the elements before value and the rest,
+// elements equal to value go to the first part when or_equal is set
+template <typename ValueT, typename PriorityT, typename Compare>
+std::tuple<nodeptr_t<ValueT, PriorityT>, nodeptr_t<ValueT, PriorityT>>
+SplitByValue(nodeptr_t<ValueT, PriorityT> node, const ValueT& value, Compare comp, bool or_equal) {
+    if (node == nullptr) {
+        return std::make_tuple(nullptr, nullptr);
+    }
+    bool goes_first = or_equal ? !comp(value, node->GetValue()) : comp(node->GetValue(), value);
+    if (goes_first) {
+        auto [split_first, split_second] = SplitByValue(node->GetRight(), value, comp, or_equal);
+        node->SetRight(split_first);
+        return std::make_tuple(node, split_second);
+    } else {
+        auto [split_first, split_second] = SplitByValue(node->GetLeft(), value, comp, or_equal);
+        node->SetLeft(split_second);
+        return std::make_tuple(split_first, node);
+    }
+}
+
+// Merges two treaps ordered by comp into one, equal elements of first stay before those of second.
+// The root with the higher priority splits the other tree by its value and both sides recurse,
+// which costs O(m log(n / m + 1)) for sizes m <= n.
+template <typename ValueT, typename PriorityT, typename Compare>
+nodeptr_t<ValueT, PriorityT>
+MergeSorted(nodeptr_t<ValueT, PriorityT> first, nodeptr_t<ValueT, PriorityT> second, Compare comp) {
+    if (first == nullptr) {
+        return second;
+    } else if (second == nullptr) {
+        return first;
+    } else if (first->GetPriority() >= second->GetPriority()) {
+        auto [split_first, split_second] = SplitByValue(second, first->GetValue(), comp, false);
+        first->SetLeft(MergeSorted(first->GetLeft(), split_first, comp));
+        first->SetRight(MergeSorted(first->GetRight(), split_second, comp));
+        return first;
+    } else {
+        auto [split_first, split_second] = SplitByValue(first, second->GetValue(), comp, true);
+        second->SetLeft(MergeSorted(split_first, second->GetLeft(), comp));
+        second->SetRight(MergeSorted(split_second, second->GetRight(), comp));
+        return second;
+    }
+}
+
+// Number of elements of a treap ordered by comp that go before value, elements equal to value
+// are counted too when or_equal is set. One descent from the root, O(log n).
+template <typename ValueT, typename PriorityT, typename Compare>
+unsigned
+CountByValue(const nodeptr_t<ValueT, PriorityT>& node, const ValueT& value, Compare comp, bool or_equal) {
+    unsigned count = 0;
+    const Node<ValueT, PriorityT>* iter = node.get();
+    while (iter != nullptr) {
+        bool goes_first = or_equal ? !comp(value, iter->GetValue()) : comp(iter->GetValue(), value);
+        if (goes_first) {
+            count += 1;
+            if (iter->GetLeft() != nullptr) {
+                count += iter->GetLeft()->GetSubtreeSize();
+            }
+            iter = iter->GetRight().get();
+        } else {
+            iter = iter->GetLeft().get();
+        }
+    }
+    return count;
+}
+
+// Inserts value into a treap ordered by comp after the elements equal to it, in one descent.
+// The position of the new element is added to position.
+template <typename ValueT, typename PriorityT, typename Compare>
+nodeptr_t<ValueT, PriorityT>
+InsertByValue(nodeptr_t<ValueT, PriorityT> node, const ValueT& value, const PriorityT& priority,
+              Compare comp, unsigned& position) {
+    if (node == nullptr) {
+        return MakeNodePtrT<ValueT, PriorityT>(value, priority);
+    } else if (node->GetPriority() < priority) {
+        auto [split_left, split_right] = SplitByValue(node, value, comp, true);
+        if (split_left != nullptr) {
+            position += split_left->GetSubtreeSize();
+        }
+        auto new_node = MakeNodePtrT<ValueT, PriorityT>(value, priority);
+        new_node->SetLeft(split_left);
+        new_node->SetRight(split_right);
+        return new_node;
+    } else if (!comp(value, node->GetValue())) {
+        position += 1;
+        if (node->GetLeft() != nullptr) {
+            position += node->GetLeft()->GetSubtreeSize();
+        }
+        node->SetRight(InsertByValue(node->GetRight(), value, priority, comp, position));
+        return node;
+    } else {
+        node->SetLeft(InsertByValue(node->GetLeft(), value, priority, comp, position));
+        return node;
+    }
+}
+
+// Links nodes given in order into a treap in O(n), nodes must have no children
+template <typename ValueT, typename PriorityT>
+nodeptr_t<ValueT, PriorityT>
+Build(const std::vector<nodeptr_t<ValueT, PriorityT>>& nodes) {
+    // right spine of the tree built so far, a node is complete when it leaves the spine
+    std::vector<nodeptr_t<ValueT, PriorityT>> spine;
+    for (const auto& node : nodes) {
+        nodeptr_t<ValueT, PriorityT> last = nullptr;
+        while (!spine.empty() && spine.back()->GetPriority() < node->GetPriority()) {
+            last = std::move(spine.back());
+            spine.pop_back();
+            last->Update();
+        }
+        node->SetLeft(last);
+        if (!spine.empty()) {
+            spine.back()->SetRight(node);
+        }
+        spine.push_back(node);
+    }
+
+    nodeptr_t<ValueT, PriorityT> root = nullptr;
+    while (!spine.empty()) {
+        root = std::move(spine.back());
+        spine.pop_back();
+        root->Update();
+    }
+    if (root != nullptr) {
+        root->SetParent(nullptr);
+    }
+    return root;
+}
+
+enum class NodeLayout {
+    kPreorder,
+    kVanEmdeBoas,
+};
+
+// Appends the nodes of the subtree at root cut to its top height levels in van Emde Boas order:
+// the top half of the levels first, then every subtree hanging below it, each laid out the same way.
+// Nested calls share stack, each one works above the entries of its callers.
+inline void
+VanEmdeBoasOrder(size_t root, size_t height, const std::vector<size_t>& left, const std::vector<size_t>& right,
+                 std::vector<size_t>& order, std::vector<std::pair<size_t, size_t>>& stack) {
+    if (height == 1) {
+        order.push_back(root);
+        return;
+    }
+    size_t top_height = height / 2;
+    VanEmdeBoasOrder(root, top_height, left, right, order, stack);
+
+    size_t base = stack.size();
+    stack.emplace_back(root, 0);
+    while (stack.size() > base) {
+        auto [index, depth] = stack.back();
+        stack.pop_back();
+        if (depth == top_height) {
+            VanEmdeBoasOrder(index, height - top_height, left, right, order, stack);
+            continue;
+        }
+        if (right[index] != SIZE_MAX) {
+            stack.emplace_back(right[index], depth + 1);
+        }
+        if (left[index] != SIZE_MAX) {
+            stack.emplace_back(left[index], depth + 1);
+        }
+    }
+}
+
+// Copies the tree with the same shape into one NodeArena, placing the nodes in the given order.
+// Values are moved out of the old nodes. O(n) in preorder, O(n log log n) in van Emde Boas order,
+// where a root to leaf path touches O(log_B n) blocks for any block size B.
+template <typename ValueT, typename PriorityT>
+nodeptr_t<ValueT, PriorityT>
+Relayout(const nodeptr_t<ValueT, PriorityT>& node, NodeLayout layout) {
+    if (node == nullptr) {
+        return nullptr;
+    }
+
+    // the tree in preorder, with children as indices
+    std::vector<Node<ValueT, PriorityT>*> nodes;
+    std::vector<size_t> left, right;
+    size_t height = 0;
+    nodes.reserve(node->GetSubtreeSize());
+    left.reserve(node->GetSubtreeSize());
+    right.reserve(node->GetSubtreeSize());
+    struct Pending {
+        Node<ValueT, PriorityT>* node;
+        size_t parent;
+        bool is_left;
+        size_t depth;
+    };
+    std::vector<Pending> stack = {{node.get(), SIZE_MAX, false, 1}};
+    while (!stack.empty()) {
+        Pending pending = stack.back();
+        stack.pop_back();
+        size_t index = nodes.size();
+        nodes.push_back(pending.node);
+        left.push_back(SIZE_MAX);
+        right.push_back(SIZE_MAX);
+        height = std::max(height, pending.depth);
+        if (pending.parent != SIZE_MAX) {
+            (pending.is_left ? left : right)[pending.parent] = index;
+        }
+        if (pending.node->GetRight() != nullptr) {
+            stack.push_back({pending.node->GetRight().get(), index, false, pending.depth + 1});
+        }
+        if (pending.node->GetLeft() != nullptr) {
+            stack.push_back({pending.node->GetLeft().get(), index, true, pending.depth + 1});
+        }
+    }
+
+    std::vector<size_t> order;
+    order.reserve(nodes.size());
+    if (layout == NodeLayout::kVanEmdeBoas) {
+        std::vector<std::pair<size_t, size_t>> stack;
+        VanEmdeBoasOrder(0, height, left, right, order, stack);
+    } else {
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            order.push_back(i);
+        }
+    }
+
+    auto* arena = new NodeArena(nodes.size());
+    std::vector<nodeptr_t<ValueT, PriorityT>> copies(nodes.size());
+    for (size_t index : order) {
+        copies[index] = MakeArenaNodePtrT<ValueT, PriorityT>(arena, std::move(nodes[index]->GetValue()), nodes[index]->GetPriority());
+    }
+    arena->Release();
+
+    // children follow their parents in preorder, so linking backwards sees complete subtrees
+    for (size_t index = copies.size(); index-- > 0;) {
+        if (left[index] != SIZE_MAX) {
+            copies[index]->SetLeft(copies[left[index]]);
+        }
+        if (right[index] != SIZE_MAX) {
+            copies[index]->SetRight(copies[right[index]]);
+        }
+    }
+    return copies.front();
+}
+
+template <typename ValueT, typename PriorityT, typename Visitor>
+void
+VisitInOrder(const nodeptr_t<ValueT, PriorityT>& node, Visitor visitor) {
+    std::vector<Node<ValueT, PriorityT>*> path;
+    Node<ValueT, PriorityT>* iter = node.get();
+    while (iter != nullptr || !path.empty()) {
+        while (iter != nullptr) {
+            path.push_back(iter);
+            iter = iter->GetLeft().get();
+        }
+        iter = path.back();
+        path.pop_back();
+        visitor(*iter);
+        iter = iter->GetRight().get();
+    }
+}
+
 template <typename ValueT, typename PriorityT>
 nodeptr_t<ValueT, PriorityT>
 GetByIndex(nodeptr_t <ValueT, PriorityT> node, unsigned index) {
@@ -385,6 +890,82 @@ GetElementsBefore(nodeptr_t<ValueT, PriorityT> node) {
     }
 }
 
+// Parent of the node in its current tree. Split and Merge do not clear the parent link of a node
+// that becomes a root, so a parent counts only while it still has the node as a child.
+template <typename ValueT, typename PriorityT>
+nodeptr_t<ValueT, PriorityT>
+GetLinkedParent(const nodeptr_t<ValueT, PriorityT>& node) {
+    auto parent = node->GetParent();
+    if (parent != nullptr && parent->GetLeft() != node && parent->GetRight() != node) {
+        return nullptr;
+    }
+    return parent;
+}
+
+// Position of the node in its tree and the root of that tree, one climb: O(depth)
+template <typename ValueT, typename PriorityT>
+std::tuple<unsigned, nodeptr_t<ValueT, PriorityT>>
+GetPositionAndRoot(nodeptr_t<ValueT, PriorityT> node) {
+    unsigned position = 0;
+    if (node->GetLeft() != nullptr) {
+        position = node->GetLeft()->GetSubtreeSize();
+    }
+    for (auto parent = GetLinkedParent(node); parent != nullptr; parent = GetLinkedParent(node)) {
+        if (node == parent->GetRight()) {
+            position += 1;
+            if (parent->GetLeft() != nullptr) {
+                position += parent->GetLeft()->GetSubtreeSize();
+            }
+        }
+        node = parent;
+    }
+    return std::make_tuple(position, node);
+}
+
+// Whether first comes before second, decided at their lowest common ancestor without counting
+// positions: O(depth). Both roots are returned so the caller can check that the nodes share a tree,
+// the order is meaningful only if they do.
+template <typename ValueT, typename PriorityT>
+std::tuple<bool, nodeptr_t<ValueT, PriorityT>, nodeptr_t<ValueT, PriorityT>>
+Precedes(nodeptr_t<ValueT, PriorityT> first, nodeptr_t<ValueT, PriorityT> second) {
+    auto climb_to_root = [](nodeptr_t<ValueT, PriorityT> node, size_t& depth) {
+        for (auto parent = GetLinkedParent(node); parent != nullptr; parent = GetLinkedParent(node)) {
+            node = parent;
+            ++depth;
+        }
+        return node;
+    };
+    size_t first_depth = 0;
+    size_t second_depth = 0;
+    auto first_root = climb_to_root(first, first_depth);
+    auto second_root = climb_to_root(second, second_depth);
+    if (first_root != second_root || first == second) {
+        return std::make_tuple(false, first_root, second_root);
+    }
+
+    // lift both to the same depth and then together, remembering the child each one came from
+    nodeptr_t<ValueT, PriorityT> first_child = nullptr;
+    nodeptr_t<ValueT, PriorityT> second_child = nullptr;
+    for (; first_depth > second_depth; --first_depth) {
+        first_child = first;
+        first = GetLinkedParent(first);
+    }
+    for (; second_depth > first_depth; --second_depth) {
+        second_child = second;
+        second = GetLinkedParent(second);
+    }
+    while (first != second) {
+        first_child = first;
+        first = GetLinkedParent(first);
+        second_child = second;
+        second = GetLinkedParent(second);
+    }
+
+    // first is either an ancestor of second or lies in the left subtree of the common ancestor
+    bool result = first_child == nullptr ? second_child == first->GetRight() : first_child == first->GetLeft();
+    return std::make_tuple(result, first_root, second_root);
+}
+
 template <typename ValueT, typename PriorityT>
 nodeptr_t<ValueT, PriorityT>
 GetRight(nodeptr_t<ValueT, PriorityT> node) {
@@ -412,4 +993,16 @@ Dump(nodeptr_t<ValueT, PriorityT> node, unsigned offset = 0) {
     if (offset == 0) {
         std::cout << "-------------------------------------------" << std::endl;
     }
-}
\ No newline at end of file
+}
+// Storage policy of AdvancedVector: shared nodes with parent links, needed by iterators
+struct SharedNodeStorage {
+    template <typename ValueT, typename PriorityT>
+    using pointer = nodeptr_t<ValueT, PriorityT>;
+
+    static constexpr bool kHasParentLinks = true;
+
+    template <typename ValueT, typename PriorityT>
+    static pointer<ValueT, PriorityT> MakeNode(const ValueT& value, const PriorityT& priority) {
+        return MakeNodePtrT<ValueT, PriorityT>(value, priority);
+    }
+};
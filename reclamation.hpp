@@ -0,0 +1,89 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Background thread that destroys detached subtrees, so dropping a large tree costs the caller
+// one queue push instead of a walk over all its nodes. Anything that converts to
+// std::shared_ptr<void> can be retired, the last reference is released on the worker thread,
+// so the destructors of the stored values must be safe to run there.
+// The instance lives until the end of the process; subtrees still queued at exit are left to the
+// operating system.
+class DeferredReclaimer {
+private:
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::vector<std::shared_ptr<void>> queue_;
+    bool busy_ = false;
+    std::thread worker_;
+
+    DeferredReclaimer();
+
+    void Run();
+
+public:
+    DeferredReclaimer(const DeferredReclaimer&) = delete;
+    DeferredReclaimer& operator=(const DeferredReclaimer&) = delete;
+
+    static DeferredReclaimer& Instance();
+
+    template <typename Pointer>
+    void Retire(Pointer garbage);
+
+    // Blocks until everything retired so far has been destroyed
+    void Drain();
+    // Number of retired subtrees the worker has not picked up yet
+    size_t Pending();
+};
+
+inline DeferredReclaimer::DeferredReclaimer() : worker_([this]() { Run(); }) {
+}
+
+inline DeferredReclaimer& DeferredReclaimer::Instance() {
+    // never destroyed: vectors with static storage duration may retire trees during exit
+    static DeferredReclaimer* instance = new DeferredReclaimer();
+    return *instance;
+}
+
+inline void DeferredReclaimer::Run() {
+    std::vector<std::shared_ptr<void>> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            busy_ = false;
+            idle_.notify_all();
+            wake_.wait(lock, [this]() { return !queue_.empty(); });
+            batch.swap(queue_);
+            busy_ = true;
+        }
+        batch.clear();
+    }
+}
+
+template <typename Pointer>
+void DeferredReclaimer::Retire(Pointer garbage) {
+    if (garbage == nullptr) {
+        return;
+    }
+    std::shared_ptr<void> erased(std::move(garbage));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(erased));
+    }
+    wake_.notify_one();
+}
+
+inline void DeferredReclaimer::Drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return queue_.empty() && !busy_; });
+}
+
+inline size_t DeferredReclaimer::Pending() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
@@ -0,0 +1,619 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <random>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+
+// Text rope on an implicit treap whose nodes hold chunks of up to kMaxChunkSize bytes.
+// Every node keeps the byte and newline counts of its subtree, so positions and line numbers
+// are found by one descent. Positions are byte offsets; UTF-8 sequences are never split when
+// the rope cuts text into chunks, but splitting inside one by position is up to the caller.
+class Rope {
+private:
+    struct Node {
+        std::string text_;
+        uint64_t priority_;
+        size_t length_;
+        size_t newlines_;
+        size_t text_newlines_;
+        std::unique_ptr<Node> left_;
+        std::unique_ptr<Node> right_;
+
+        Node(std::string text, uint64_t priority);
+
+        // Recounts newlines of text_ and then updates the subtree counters
+        void UpdateText();
+        void Update();
+    };
+
+    using node_ptr = std::unique_ptr<Node>;
+
+    node_ptr root_;
+    std::mt19937_64 gen_;
+
+    static size_t Length(const node_ptr& node);
+    static size_t Newlines(const node_ptr& node);
+    static std::pair<node_ptr, node_ptr> Split(node_ptr node, size_t position);
+    static node_ptr Merge(node_ptr left, node_ptr right);
+    static node_ptr DeepCopy(const node_ptr& node);
+    static bool InsertIntoChunk(Node* node, size_t position, std::string_view text);
+    static bool EraseFromChunk(Node* node, size_t position, size_t length);
+
+    // find for needles longer than a chunk
+    size_t FindLong(std::string_view needle, size_t position) const;
+
+    node_ptr MakeChunks(std::string_view text);
+    // Start and size of the chunk holding position
+    std::pair<size_t, size_t> ChunkAt(size_t position) const;
+    // Merges the chunk holding position with a neighbour while it is shorter than kMinChunkSize,
+    // O(log n + kMaxChunkSize)
+    void Coalesce(size_t position);
+    // Chunks around a place where the text was cut or joined
+    void CoalesceAround(size_t position);
+
+    // Calls visitor(text, text_start) for chunks in order, starting with the one holding position,
+    // until the visitor returns false
+    template <typename Visitor>
+    void VisitChunks(size_t position, Visitor visitor) const;
+
+public:
+    static constexpr size_t npos = std::string::npos;
+    static constexpr size_t kMaxChunkSize = 512;
+    // Edits merge shorter chunks into a neighbour, so a rope of n bytes keeps at most
+    // about n / kMinChunkSize + 1 nodes however it was edited
+    static constexpr size_t kMinChunkSize = kMaxChunkSize / 4;
+
+    Rope() = default;
+    explicit Rope(std::string_view text);
+    Rope(const Rope& other);
+    Rope(Rope&& other) noexcept = default;
+    Rope& operator=(const Rope& other);
+    Rope& operator=(Rope&& other) noexcept = default;
+
+    size_t size() const;
+    bool empty() const;
+    void clear();
+
+    // Number of nodes, O(chunks)
+    size_t chunks() const;
+
+    // Number of lines, i.e. newlines + 1
+    size_t lines() const;
+
+    char operator[](size_t position) const;
+
+    // O(log n + |text| / kMaxChunkSize)
+    void insert(size_t position, std::string_view text);
+    void append(std::string_view text);
+    // O(log n), length is clamped to the end of the text
+    void erase(size_t position, size_t length);
+
+    std::string substr(size_t position, size_t length = npos) const;
+    std::string to_string() const;
+
+    // First occurrence of needle starting at position or later, npos if there is none.
+    // O(n + m) in the worst case and no allocations for needles up to kMaxChunkSize
+    size_t find(std::string_view needle, size_t position = 0) const;
+
+    // Position of the first character of a line (0-based), O(log n + kMaxChunkSize)
+    size_t line_start(size_t line) const;
+    // Line (0-based) holding a position, O(log n + kMaxChunkSize)
+    size_t line_of(size_t position) const;
+};
+
+inline Rope::Node::Node(std::string text, uint64_t priority)
+        : text_(std::move(text)), priority_(priority), length_(0), newlines_(0), text_newlines_(0) {
+    UpdateText();
+}
+
+inline void Rope::Node::UpdateText() {
+    text_newlines_ = std::count(text_.begin(), text_.end(), '\n');
+    Update();
+}
+
+inline void Rope::Node::Update() {
+    length_ = Length(left_) + text_.size() + Length(right_);
+    newlines_ = Newlines(left_) + text_newlines_ + Newlines(right_);
+}
+
+inline size_t Rope::Length(const node_ptr& node) {
+    return node == nullptr ? 0 : node->length_;
+}
+
+inline size_t Rope::Newlines(const node_ptr& node) {
+    return node == nullptr ? 0 : node->newlines_;
+}
+
+inline std::pair<Rope::node_ptr, Rope::node_ptr> Rope::Split(node_ptr node, size_t position) {
+    if (node == nullptr) {
+        return std::make_pair(nullptr, nullptr);
+    }
+
+    size_t left_length = Length(node->left_);
+    if (position <= left_length) {
+        auto [split_first, split_second] = Split(std::move(node->left_), position);
+        node->left_ = std::move(split_second);
+        node->Update();
+        return std::make_pair(std::move(split_first), std::move(node));
+    } else if (position >= left_length + node->text_.size()) {
+        auto [split_first, split_second] = Split(std::move(node->right_),
+                                                 position - left_length - node->text_.size());
+        node->right_ = std::move(split_first);
+        node->Update();
+        return std::make_pair(std::move(node), std::move(split_second));
+    } else {
+        // the cut goes through this chunk: the tail becomes a node with the same priority
+        size_t offset = position - left_length;
+        node_ptr tail = std::make_unique<Node>(node->text_.substr(offset), node->priority_);
+        tail->right_ = std::move(node->right_);
+        tail->Update();
+        node->text_.resize(offset);
+        node->UpdateText();
+        return std::make_pair(std::move(node), std::move(tail));
+    }
+}
+
+inline Rope::node_ptr Rope::Merge(node_ptr left, node_ptr right) {
+    if (left == nullptr) {
+        return right;
+    } else if (right == nullptr) {
+        return left;
+    } else if (left->priority_ > right->priority_) {
+        left->right_ = Merge(std::move(left->right_), std::move(right));
+        left->Update();
+        return left;
+    } else {
+        right->left_ = Merge(std::move(left), std::move(right->left_));
+        right->Update();
+        return right;
+    }
+}
+
+inline Rope::node_ptr Rope::DeepCopy(const node_ptr& node) {
+    if (node == nullptr) {
+        return nullptr;
+    }
+    node_ptr result = std::make_unique<Node>(node->text_, node->priority_);
+    result->left_ = DeepCopy(node->left_);
+    result->right_ = DeepCopy(node->right_);
+    result->Update();
+    return result;
+}
+
+inline bool Rope::InsertIntoChunk(Node* node, size_t position, std::string_view text) {
+    size_t left_length = Length(node->left_);
+    if (position < left_length) {
+        if (!InsertIntoChunk(node->left_.get(), position, text)) {
+            return false;
+        }
+    } else if (position <= left_length + node->text_.size()) {
+        if (node->text_.size() + text.size() > kMaxChunkSize) {
+            return false;
+        }
+        node->text_.insert(position - left_length, text);
+        node->UpdateText();
+        return true;
+    } else {
+        if (!InsertIntoChunk(node->right_.get(), position - left_length - node->text_.size(), text)) {
+            return false;
+        }
+    }
+    node->Update();
+    return true;
+}
+
+inline bool Rope::EraseFromChunk(Node* node, size_t position, size_t length) {
+    size_t left_length = Length(node->left_);
+    size_t text_end = left_length + node->text_.size();
+    if (position + length <= left_length) {
+        if (!EraseFromChunk(node->left_.get(), position, length)) {
+            return false;
+        }
+    } else if (position >= left_length && position + length <= text_end) {
+        if (length == node->text_.size()) {
+            return false;
+        }
+        node->text_.erase(position - left_length, length);
+        node->UpdateText();
+        return true;
+    } else if (position >= text_end) {
+        if (!EraseFromChunk(node->right_.get(), position - text_end, length)) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    node->Update();
+    return true;
+}
+
+inline Rope::node_ptr Rope::MakeChunks(std::string_view text) {
+    node_ptr result = nullptr;
+    while (!text.empty()) {
+        size_t cut = std::min(text.size(), kMaxChunkSize);
+        // do not cut a UTF-8 sequence: continuation bytes look like 10xxxxxx
+        while (cut < text.size() && cut > 0 && (static_cast<unsigned char>(text[cut]) & 0xC0) == 0x80) {
+            --cut;
+        }
+        if (cut == 0) {
+            cut = std::min(text.size(), kMaxChunkSize);
+        }
+        result = Merge(std::move(result), std::make_unique<Node>(std::string(text.substr(0, cut)), gen_()));
+        text.remove_prefix(cut);
+    }
+    return result;
+}
+
+inline std::pair<size_t, size_t> Rope::ChunkAt(size_t position) const {
+    const Node* node = root_.get();
+    size_t base = 0;
+    while (true) {
+        size_t left_length = Length(node->left_);
+        if (position < base + left_length) {
+            node = node->left_.get();
+        } else if (position < base + left_length + node->text_.size()) {
+            return std::make_pair(base + left_length, node->text_.size());
+        } else {
+            base += left_length + node->text_.size();
+            node = node->right_.get();
+        }
+    }
+}
+
+inline void Rope::Coalesce(size_t position) {
+    while (position < size()) {
+        auto [start, length] = ChunkAt(position);
+        if (length >= kMinChunkSize || length == size()) {
+            return;
+        }
+        // join with the shorter neighbour
+        size_t from = start;
+        size_t to = start + length;
+        if (start > 0 && (to == size() || ChunkAt(start - 1).second <= ChunkAt(to).second)) {
+            from = ChunkAt(start - 1).first;
+        } else {
+            to += ChunkAt(to).second;
+        }
+
+        auto [head, rest] = Split(std::move(root_), from);
+        auto [neighbours, tail] = Split(std::move(rest), to - from);
+        std::string text = std::move(neighbours->text_);
+        if (neighbours->left_ != nullptr) {
+            text.insert(0, neighbours->left_->text_);
+        }
+        if (neighbours->right_ != nullptr) {
+            text.append(neighbours->right_->text_);
+        }
+        // two chunks longer than kMaxChunkSize are cut in halves, both stay above kMinChunkSize
+        node_ptr joined;
+        if (text.size() <= kMaxChunkSize) {
+            joined = std::make_unique<Node>(std::move(text), gen_());
+        } else {
+            size_t cut = text.size() / 2;
+            while (cut > 0 && (static_cast<unsigned char>(text[cut]) & 0xC0) == 0x80) {
+                --cut;
+            }
+            if (cut == 0) {
+                cut = text.size() / 2;
+            }
+            joined = Merge(std::make_unique<Node>(text.substr(0, cut), gen_()),
+                           std::make_unique<Node>(text.substr(cut), gen_()));
+        }
+        root_ = Merge(Merge(std::move(head), std::move(joined)), std::move(tail));
+        position = from;
+    }
+}
+
+inline void Rope::CoalesceAround(size_t position) {
+    if (position > 0) {
+        Coalesce(position - 1);
+    }
+    Coalesce(std::min(position, size()));
+}
+
+template <typename Visitor>
+void Rope::VisitChunks(size_t position, Visitor visitor) const {
+    // nodes whose chunk and right subtree are still to be visited, with the start of the chunk
+    std::vector<std::pair<const Node*, size_t>> pending;
+    const Node* node = root_.get();
+    size_t base = 0;
+    while (node != nullptr) {
+        size_t left_length = Length(node->left_);
+        if (position < base + left_length) {
+            pending.emplace_back(node, base + left_length);
+            node = node->left_.get();
+        } else if (position < base + left_length + node->text_.size()) {
+            pending.emplace_back(node, base + left_length);
+            break;
+        } else {
+            base += left_length + node->text_.size();
+            node = node->right_.get();
+        }
+    }
+
+    while (!pending.empty()) {
+        auto [current, start] = pending.back();
+        pending.pop_back();
+        if (!visitor(std::string_view(current->text_), start)) {
+            return;
+        }
+        size_t subtree_start = start + current->text_.size();
+        for (const Node* iter = current->right_.get(); iter != nullptr; iter = iter->left_.get()) {
+            pending.emplace_back(iter, subtree_start + Length(iter->left_));
+        }
+    }
+}
+
+inline Rope::Rope(std::string_view text) : root_(nullptr) {
+    root_ = MakeChunks(text);
+}
+
+inline Rope::Rope(const Rope& other) : root_(DeepCopy(other.root_)) {
+}
+
+inline Rope& Rope::operator=(const Rope& other) {
+    if (this != &other) {
+        root_ = DeepCopy(other.root_);
+    }
+    return *this;
+}
+
+inline size_t Rope::size() const {
+    return Length(root_);
+}
+
+inline bool Rope::empty() const {
+    return root_ == nullptr;
+}
+
+inline void Rope::clear() {
+    root_ = nullptr;
+}
+
+inline size_t Rope::lines() const {
+    return Newlines(root_) + 1;
+}
+
+inline char Rope::operator[](size_t position) const {
+    if (position >= size()) {
+        throw std::range_error("Rope: position is out of range");
+    }
+    const Node* node = root_.get();
+    while (true) {
+        size_t left_length = Length(node->left_);
+        if (position < left_length) {
+            node = node->left_.get();
+        } else if (position < left_length + node->text_.size()) {
+            return node->text_[position - left_length];
+        } else {
+            position -= left_length + node->text_.size();
+            node = node->right_.get();
+        }
+    }
+}
+
+inline void Rope::insert(size_t position, std::string_view text) {
+    if (position > size()) {
+        throw std::range_error("Rope: position is out of range");
+    }
+    if (text.empty()) {
+        return;
+    }
+    if (root_ != nullptr && text.size() <= kMaxChunkSize && InsertIntoChunk(root_.get(), position, text)) {
+        return;
+    }
+    auto [split_first, split_second] = Split(std::move(root_), position);
+    root_ = Merge(Merge(std::move(split_first), MakeChunks(text)), std::move(split_second));
+    // the cut and the last new chunk may have left short chunks at both ends of the insertion
+    CoalesceAround(position);
+    CoalesceAround(position + text.size());
+}
+
+inline void Rope::append(std::string_view text) {
+    insert(size(), text);
+}
+
+inline void Rope::erase(size_t position, size_t length) {
+    if (position > size()) {
+        throw std::range_error("Rope: position is out of range");
+    }
+    length = std::min(length, size() - position);
+    if (length == 0) {
+        return;
+    }
+    if (!EraseFromChunk(root_.get(), position, length)) {
+        auto [head, rest] = Split(std::move(root_), position);
+        auto [erased, tail] = Split(std::move(rest), length);
+        root_ = Merge(std::move(head), std::move(tail));
+    }
+    CoalesceAround(position);
+}
+
+inline size_t Rope::chunks() const {
+    size_t result = 0;
+    VisitChunks(0, [&result](std::string_view, size_t) {
+        ++result;
+        return true;
+    });
+    return result;
+}
+
+inline std::string Rope::substr(size_t position, size_t length) const {
+    if (position > size()) {
+        throw std::range_error("Rope: position is out of range");
+    }
+    length = std::min(length, size() - position);
+
+    std::string result;
+    result.reserve(length);
+    VisitChunks(position, [&result, position, length](std::string_view text, size_t start) {
+        if (start < position) {
+            text.remove_prefix(position - start);
+        }
+        result.append(text.substr(0, length - result.size()));
+        return result.size() < length;
+    });
+    return result;
+}
+
+inline std::string Rope::to_string() const {
+    return substr(0);
+}
+
+inline size_t Rope::find(std::string_view needle, size_t position) const {
+    if (position > size()) {
+        return npos;
+    }
+    if (needle.empty()) {
+        return position;
+    }
+    if (needle.size() > kMaxChunkSize) {
+        return FindLong(needle, position);
+    }
+
+    // memmem (two-way in glibc) inside each chunk; a match crossing a chunk border starts in the
+    // last needle.size() - 1 bytes seen and is searched in carry + head of the next chunk
+    size_t keep = needle.size() - 1;
+    char carry[kMaxChunkSize];
+    char boundary[2 * kMaxChunkSize];
+    size_t carry_size = 0;
+    size_t carry_start = position;
+    size_t result = npos;
+
+    VisitChunks(position, [&](std::string_view text, size_t start) {
+        if (start < position) {
+            text.remove_prefix(position - start);
+            start = position;
+        }
+        if (carry_size > 0) {
+            size_t head = std::min(keep, text.size());
+            std::memcpy(boundary, carry, carry_size);
+            std::memcpy(boundary + carry_size, text.data(), head);
+            const void* found = memmem(boundary, carry_size + head, needle.data(), needle.size());
+            if (found != nullptr) {
+                result = carry_start + (static_cast<const char*>(found) - boundary);
+                return false;
+            }
+        }
+        const void* found = memmem(text.data(), text.size(), needle.data(), needle.size());
+        if (found != nullptr) {
+            result = start + (static_cast<const char*>(found) - text.data());
+            return false;
+        }
+
+        if (text.size() >= keep) {
+            std::memcpy(carry, text.data() + text.size() - keep, keep);
+            carry_size = keep;
+            carry_start = start + text.size() - keep;
+        } else {
+            size_t drop = carry_size + text.size() > keep ? carry_size + text.size() - keep : 0;
+            std::memmove(carry, carry + drop, carry_size - drop);
+            std::memcpy(carry + carry_size - drop, text.data(), text.size());
+            carry_size += text.size() - drop;
+            carry_start += drop;
+        }
+        return true;
+    });
+    return result;
+}
+
+inline size_t Rope::FindLong(std::string_view needle, size_t position) const {
+    // every match spans several chunks: one Knuth-Morris-Pratt pass over the stream, O(n + m)
+    std::vector<size_t> prefix(needle.size(), 0);
+    for (size_t i = 1, matched = 0; i < needle.size(); ++i) {
+        while (matched > 0 && needle[i] != needle[matched]) {
+            matched = prefix[matched - 1];
+        }
+        if (needle[i] == needle[matched]) {
+            ++matched;
+        }
+        prefix[i] = matched;
+    }
+
+    size_t matched = 0;
+    size_t result = npos;
+    VisitChunks(position, [&](std::string_view text, size_t start) {
+        if (start < position) {
+            text.remove_prefix(position - start);
+            start = position;
+        }
+        for (size_t i = 0; i < text.size(); ++i) {
+            while (matched > 0 && text[i] != needle[matched]) {
+                matched = prefix[matched - 1];
+            }
+            if (text[i] == needle[matched]) {
+                ++matched;
+            }
+            if (matched == needle.size()) {
+                result = start + i + 1 - needle.size();
+                return false;
+            }
+        }
+        return true;
+    });
+    return result;
+}
+
+inline size_t Rope::line_start(size_t line) const {
+    if (line > Newlines(root_)) {
+        throw std::range_error("Rope: line is out of range");
+    }
+    if (line == 0) {
+        return 0;
+    }
+
+    // position right after the line-th newline
+    const Node* node = root_.get();
+    size_t base = 0;
+    while (true) {
+        size_t left_newlines = Newlines(node->left_);
+        if (line <= left_newlines) {
+            node = node->left_.get();
+        } else if (line <= left_newlines + node->text_newlines_) {
+            line -= left_newlines;
+            size_t offset = 0;
+            for (; line > 0; ++offset) {
+                if (node->text_[offset] == '\n') {
+                    --line;
+                }
+            }
+            return base + Length(node->left_) + offset;
+        } else {
+            line -= left_newlines + node->text_newlines_;
+            base += Length(node->left_) + node->text_.size();
+            node = node->right_.get();
+        }
+    }
+}
+
+inline size_t Rope::line_of(size_t position) const {
+    if (position > size()) {
+        throw std::range_error("Rope: position is out of range");
+    }
+
+    size_t newlines = 0;
+    const Node* node = root_.get();
+    while (node != nullptr) {
+        size_t left_length = Length(node->left_);
+        if (position < left_length) {
+            node = node->left_.get();
+            continue;
+        }
+        newlines += Newlines(node->left_);
+        position -= left_length;
+        if (position < node->text_.size()) {
+            return newlines + std::count(node->text_.begin(), node->text_.begin() + position, '\n');
+        }
+        newlines += node->text_newlines_;
+        position -= node->text_.size();
+        node = node->right_.get();
+    }
+    return newlines;
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <decartian.hpp>
+
+// AdvancedVector with a small-buffer optimization: up to N elements are kept inline in an array,
+// where insert and erase shift the tail (memmove for trivially copyable T). The treap, together
+// with its random generator, is allocated only when the size exceeds N, and the elements move back
+// inline once it drops to N / 2, so alternating around N does not rebuild the tree every time.
+// T must be default constructible and move assignable.
+template <typename T, size_t N = 16, class RandomGenerator = std::mt19937_64, class Storage = SharedNodeStorage>
+class SmallAdvancedVector {
+    static_assert(N > 0, "SmallAdvancedVector: inline capacity must be positive");
+
+public:
+    using value_type = T;
+    using tree_type = AdvancedVector<T, RandomGenerator, Storage>;
+
+private:
+    std::array<T, N> inline_;
+    size_t inline_size_;
+    std::unique_ptr<tree_type> tree_;
+
+    // Moves the inline elements to a new tree
+    void promote();
+    // Moves the elements back inline when the tree got small enough
+    void demote_if_small();
+
+public:
+    SmallAdvancedVector();
+    SmallAdvancedVector(std::initializer_list<T> list);
+    SmallAdvancedVector(const SmallAdvancedVector<T, N, RandomGenerator, Storage>& other);
+    SmallAdvancedVector(SmallAdvancedVector<T, N, RandomGenerator, Storage>&& other) noexcept = default;
+    SmallAdvancedVector<T, N, RandomGenerator, Storage>&
+    operator=(const SmallAdvancedVector<T, N, RandomGenerator, Storage>& other);
+    SmallAdvancedVector<T, N, RandomGenerator, Storage>&
+    operator=(SmallAdvancedVector<T, N, RandomGenerator, Storage>&& other) noexcept = default;
+
+    size_t size() const;
+    bool empty() const;
+    void clear();
+
+    // true while the elements are stored inline
+    bool is_inline() const;
+    static constexpr size_t inline_capacity() { return N; }
+
+    const T& operator[](unsigned index) const;
+    T& operator[](unsigned index);
+
+    const T& front() const;
+    T& front();
+    const T& back() const;
+    T& back();
+
+    void push_back(const T& value);
+    void push_front(const T& value);
+    void insert(unsigned position, const T& value);
+    void erase(unsigned position);
+    void erase(unsigned position, unsigned length);
+
+    bool operator==(const SmallAdvancedVector<T, N, RandomGenerator, Storage>& other) const;
+
+    std::vector<T> to_vector() const;
+    template <typename OutputIt>
+    OutputIt copy_to(OutputIt destination) const;
+};
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+SmallAdvancedVector<T, N, RandomGenerator, Storage>::SmallAdvancedVector()
+        : inline_(), inline_size_(0), tree_(nullptr) {
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+SmallAdvancedVector<T, N, RandomGenerator, Storage>::SmallAdvancedVector(std::initializer_list<T> list)
+        : SmallAdvancedVector() {
+    if (list.size() > N) {
+        tree_ = std::make_unique<tree_type>(list);
+    } else {
+        std::copy(list.begin(), list.end(), inline_.begin());
+        inline_size_ = list.size();
+    }
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+SmallAdvancedVector<T, N, RandomGenerator, Storage>::SmallAdvancedVector(
+        const SmallAdvancedVector<T, N, RandomGenerator, Storage>& other)
+        : inline_(other.inline_), inline_size_(other.inline_size_),
+          tree_(other.tree_ == nullptr ? nullptr : std::make_unique<tree_type>(*other.tree_)) {
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+SmallAdvancedVector<T, N, RandomGenerator, Storage>&
+SmallAdvancedVector<T, N, RandomGenerator, Storage>::operator=(
+        const SmallAdvancedVector<T, N, RandomGenerator, Storage>& other) {
+    if (this != &other) {
+        inline_ = other.inline_;
+        inline_size_ = other.inline_size_;
+        tree_ = other.tree_ == nullptr ? nullptr : std::make_unique<tree_type>(*other.tree_);
+    }
+    return *this;
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+void SmallAdvancedVector<T, N, RandomGenerator, Storage>::promote() {
+    tree_ = std::make_unique<tree_type>(inline_.begin(), inline_.begin() + inline_size_);
+    std::fill(inline_.begin(), inline_.begin() + inline_size_, T());
+    inline_size_ = 0;
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+void SmallAdvancedVector<T, N, RandomGenerator, Storage>::demote_if_small() {
+    if (tree_ != nullptr && tree_->size() <= N / 2) {
+        inline_size_ = tree_->size();
+        tree_->copy_to(inline_.begin());
+        tree_ = nullptr;
+    }
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+size_t SmallAdvancedVector<T, N, RandomGenerator, Storage>::size() const {
+    return tree_ == nullptr ? inline_size_ : tree_->size();
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+bool SmallAdvancedVector<T, N, RandomGenerator, Storage>::empty() const {
+    return size() == 0;
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+void SmallAdvancedVector<T, N, RandomGenerator, Storage>::clear() {
+    std::fill(inline_.begin(), inline_.begin() + inline_size_, T());
+    inline_size_ = 0;
+    tree_ = nullptr;
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+bool SmallAdvancedVector<T, N, RandomGenerator, Storage>::is_inline() const {
+    return tree_ == nullptr;
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+const T& SmallAdvancedVector<T, N, RandomGenerator, Storage>::operator[](unsigned index) const {
+    if (tree_ == nullptr) {
+        return inline_[index];
+    }
+    return static_cast<const tree_type&>(*tree_)[index];
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+T& SmallAdvancedVector<T, N, RandomGenerator, Storage>::operator[](unsigned index) {
+    if (tree_ == nullptr) {
+        return inline_[index];
+    }
+    return (*tree_)[index];
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+const T& SmallAdvancedVector<T, N, RandomGenerator, Storage>::front() const {
+    return operator[](0);
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+T& SmallAdvancedVector<T, N, RandomGenerator, Storage>::front() {
+    return operator[](0);
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+const T& SmallAdvancedVector<T, N, RandomGenerator, Storage>::back() const {
+    return operator[](size() - 1);
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+T& SmallAdvancedVector<T, N, RandomGenerator, Storage>::back() {
+    return operator[](size() - 1);
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+void SmallAdvancedVector<T, N, RandomGenerator, Storage>::push_back(const T& value) {
+    insert(size(), value);
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+void SmallAdvancedVector<T, N, RandomGenerator, Storage>::push_front(const T& value) {
+    insert(0, value);
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+void SmallAdvancedVector<T, N, RandomGenerator, Storage>::insert(unsigned position, const T& value) {
+    // checked before promotion, so a bad position neither allocates the tree nor reaches it
+    if (position > size()) {
+        throw std::range_error("SmallAdvancedVector: position is out of range");
+    }
+    if (tree_ == nullptr && inline_size_ == N) {
+        promote();
+    }
+    if (tree_ != nullptr) {
+        tree_->insert(position, value);
+        return;
+    }
+    std::move_backward(inline_.begin() + position, inline_.begin() + inline_size_,
+                       inline_.begin() + inline_size_ + 1);
+    inline_[position] = value;
+    ++inline_size_;
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+void SmallAdvancedVector<T, N, RandomGenerator, Storage>::erase(unsigned position) {
+    if (position < size()) {
+        erase(position, 1);
+    }
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+void SmallAdvancedVector<T, N, RandomGenerator, Storage>::erase(unsigned position, unsigned length) {
+    if (tree_ != nullptr) {
+        tree_->erase(position, length);
+        demote_if_small();
+        return;
+    }
+    if (position >= inline_size_) {
+        return;
+    }
+    size_t end = position + std::min<size_t>(length, inline_size_ - position);
+    std::move(inline_.begin() + end, inline_.begin() + inline_size_, inline_.begin() + position);
+    std::fill(inline_.begin() + inline_size_ - (end - position), inline_.begin() + inline_size_, T());
+    inline_size_ -= end - position;
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+bool SmallAdvancedVector<T, N, RandomGenerator, Storage>::operator==(
+        const SmallAdvancedVector<T, N, RandomGenerator, Storage>& other) const {
+    return size() == other.size() && to_vector() == other.to_vector();
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+std::vector<T> SmallAdvancedVector<T, N, RandomGenerator, Storage>::to_vector() const {
+    std::vector<T> result;
+    result.reserve(size());
+    copy_to(std::back_inserter(result));
+    return result;
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+template <typename OutputIt>
+OutputIt SmallAdvancedVector<T, N, RandomGenerator, Storage>::copy_to(OutputIt destination) const {
+    if (tree_ == nullptr) {
+        return std::copy(inline_.begin(), inline_.begin() + inline_size_, destination);
+    }
+    return tree_->copy_to(destination);
+}
+
+template <typename T, size_t N, class RandomGenerator, class Storage>
+std::ostream&
+operator<<(std::ostream& output_stream, const SmallAdvancedVector<T, N, RandomGenerator, Storage>& data) {
+    data.copy_to(std::ostream_iterator<T>(output_stream, " "));
+    return output_stream;
+}
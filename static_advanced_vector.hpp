@@ -0,0 +1,408 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// AdvancedVector with at most Capacity elements and no heap allocations: nodes live in an inline
+// array and are linked by indices, free nodes form a list through their left links. Split/Merge
+// work inside the pool in O(log n). Operations that take or return another vector copy the nodes
+// between pools, O(length). T must be default constructible, unused slots hold default values.
+// Running out of nodes throws std::length_error before the vector is changed.
+template <typename T, size_t Capacity>
+class StaticAdvancedVector {
+    static_assert(Capacity < UINT32_MAX, "StaticAdvancedVector: capacity is too large");
+
+public:
+    using value_type = T;
+    using index_type = typename std::conditional<(Capacity < UINT16_MAX), uint16_t, uint32_t>::type;
+
+private:
+    static constexpr index_type kNull = static_cast<index_type>(-1);
+
+    struct Slot {
+        T value_;
+        uint32_t priority_;
+        index_type size_;
+        index_type left_;
+        index_type right_;
+    };
+
+    std::array<Slot, Capacity> pool_;
+    index_type root_;
+    index_type free_;
+    index_type free_count_;
+    std::minstd_rand gen_;
+
+    index_type Size(index_type node) const;
+    void Update(index_type node);
+
+    index_type Allocate(const T& value, uint32_t priority);
+    void Free(index_type node);
+    void Reserve(size_t count) const;
+
+    std::pair<index_type, index_type> Split(index_type node, size_t index);
+    index_type Merge(index_type left, index_type right);
+    index_type Find(index_type node, size_t index) const;
+    // Copies a subtree of another pool into this one, keeping its shape and priorities
+    index_type CopyFrom(const StaticAdvancedVector<T, Capacity>& source, index_type node);
+
+    template <typename Visitor>
+    void VisitInOrder(index_type node, Visitor& visitor) const;
+
+public:
+    StaticAdvancedVector();
+    StaticAdvancedVector(std::initializer_list<T> list);
+
+    size_t size() const;
+    bool empty() const;
+    static constexpr size_t capacity() { return Capacity; }
+    void clear();
+
+    const T& operator[](size_t index) const;
+    T& operator[](size_t index);
+
+    const T& front() const;
+    T& front();
+    const T& back() const;
+    T& back();
+
+    void push_back(const T& value);
+    void push_front(const T& value);
+
+    // O(log n)
+    void insert(size_t position, const T& value);
+    void erase(size_t position);
+    // O(log n + length), the erased nodes return to the pool
+    void erase(size_t position, size_t length);
+
+    // O(log n + |data|)
+    void insert(size_t position, const StaticAdvancedVector<T, Capacity>& data);
+    StaticAdvancedVector<T, Capacity>& operator+=(const StaticAdvancedVector<T, Capacity>& rhs);
+
+    // O(log n + length)
+    StaticAdvancedVector<T, Capacity> cut_subarray(size_t position, size_t length);
+    StaticAdvancedVector<T, Capacity> copy_subarray(size_t position, size_t length);
+
+    // Moves [position, position + length) so that it starts at destination of the remaining
+    // elements, O(log n) since the nodes stay in the same pool
+    void move_subarray(size_t position, size_t length, size_t destination);
+
+    bool operator==(const StaticAdvancedVector<T, Capacity>& other) const;
+
+    std::vector<T> to_vector() const;
+    template <typename OutputIt>
+    OutputIt copy_to(OutputIt destination) const;
+};
+
+template <typename T, size_t Capacity>
+StaticAdvancedVector<T, Capacity>::StaticAdvancedVector()
+        : pool_(), root_(kNull), free_(Capacity == 0 ? kNull : 0), free_count_(Capacity), gen_() {
+    for (size_t i = 0; i < Capacity; ++i) {
+        pool_[i].left_ = i + 1 < Capacity ? static_cast<index_type>(i + 1) : kNull;
+    }
+}
+
+template <typename T, size_t Capacity>
+StaticAdvancedVector<T, Capacity>::StaticAdvancedVector(std::initializer_list<T> list)
+        : StaticAdvancedVector() {
+    Reserve(list.size());
+    for (const auto& elem : list) {
+        push_back(elem);
+    }
+}
+
+template <typename T, size_t Capacity>
+typename StaticAdvancedVector<T, Capacity>::index_type
+StaticAdvancedVector<T, Capacity>::Size(index_type node) const {
+    return node == kNull ? 0 : pool_[node].size_;
+}
+
+template <typename T, size_t Capacity>
+void StaticAdvancedVector<T, Capacity>::Update(index_type node) {
+    pool_[node].size_ = Size(pool_[node].left_) + Size(pool_[node].right_) + 1;
+}
+
+template <typename T, size_t Capacity>
+typename StaticAdvancedVector<T, Capacity>::index_type
+StaticAdvancedVector<T, Capacity>::Allocate(const T& value, uint32_t priority) {
+    Reserve(1);
+    index_type node = free_;
+    free_ = pool_[node].left_;
+    --free_count_;
+
+    pool_[node].value_ = value;
+    pool_[node].priority_ = priority;
+    pool_[node].size_ = 1;
+    pool_[node].left_ = kNull;
+    pool_[node].right_ = kNull;
+    return node;
+}
+
+template <typename T, size_t Capacity>
+void StaticAdvancedVector<T, Capacity>::Free(index_type node) {
+    if (node == kNull) {
+        return;
+    }
+    Free(pool_[node].left_);
+    Free(pool_[node].right_);
+    pool_[node].value_ = T();
+    pool_[node].right_ = kNull;
+    pool_[node].left_ = free_;
+    free_ = node;
+    ++free_count_;
+}
+
+template <typename T, size_t Capacity>
+void StaticAdvancedVector<T, Capacity>::Reserve(size_t count) const {
+    if (count > free_count_) {
+        throw std::length_error("StaticAdvancedVector: capacity exceeded");
+    }
+}
+
+template <typename T, size_t Capacity>
+std::pair<typename StaticAdvancedVector<T, Capacity>::index_type,
+          typename StaticAdvancedVector<T, Capacity>::index_type>
+StaticAdvancedVector<T, Capacity>::Split(index_type node, size_t index) {
+    if (node == kNull) {
+        return std::make_pair(kNull, kNull);
+    }
+    size_t elements_before = Size(pool_[node].left_);
+    if (elements_before >= index) {
+        auto [split_first, split_second] = Split(pool_[node].left_, index);
+        pool_[node].left_ = split_second;
+        Update(node);
+        return std::make_pair(split_first, node);
+    } else {
+        auto [split_first, split_second] = Split(pool_[node].right_, index - elements_before - 1);
+        pool_[node].right_ = split_first;
+        Update(node);
+        return std::make_pair(node, split_second);
+    }
+}
+
+template <typename T, size_t Capacity>
+typename StaticAdvancedVector<T, Capacity>::index_type
+StaticAdvancedVector<T, Capacity>::Merge(index_type left, index_type right) {
+    if (left == kNull) {
+        return right;
+    } else if (right == kNull) {
+        return left;
+    } else if (pool_[left].priority_ > pool_[right].priority_) {
+        pool_[left].right_ = Merge(pool_[left].right_, right);
+        Update(left);
+        return left;
+    } else {
+        pool_[right].left_ = Merge(left, pool_[right].left_);
+        Update(right);
+        return right;
+    }
+}
+
+template <typename T, size_t Capacity>
+typename StaticAdvancedVector<T, Capacity>::index_type
+StaticAdvancedVector<T, Capacity>::Find(index_type node, size_t index) const {
+    while (node != kNull) {
+        size_t elements_before = Size(pool_[node].left_);
+        if (elements_before == index) {
+            return node;
+        } else if (elements_before > index) {
+            node = pool_[node].left_;
+        } else {
+            index -= elements_before + 1;
+            node = pool_[node].right_;
+        }
+    }
+    return kNull;
+}
+
+template <typename T, size_t Capacity>
+typename StaticAdvancedVector<T, Capacity>::index_type
+StaticAdvancedVector<T, Capacity>::CopyFrom(const StaticAdvancedVector<T, Capacity>& source, index_type node) {
+    if (node == kNull) {
+        return kNull;
+    }
+    index_type result = Allocate(source.pool_[node].value_, source.pool_[node].priority_);
+    index_type left = CopyFrom(source, source.pool_[node].left_);
+    index_type right = CopyFrom(source, source.pool_[node].right_);
+    pool_[result].left_ = left;
+    pool_[result].right_ = right;
+    Update(result);
+    return result;
+}
+
+template <typename T, size_t Capacity>
+template <typename Visitor>
+void StaticAdvancedVector<T, Capacity>::VisitInOrder(index_type node, Visitor& visitor) const {
+    if (node != kNull) {
+        VisitInOrder(pool_[node].left_, visitor);
+        visitor(pool_[node].value_);
+        VisitInOrder(pool_[node].right_, visitor);
+    }
+}
+
+template <typename T, size_t Capacity>
+size_t StaticAdvancedVector<T, Capacity>::size() const {
+    return Size(root_);
+}
+
+template <typename T, size_t Capacity>
+bool StaticAdvancedVector<T, Capacity>::empty() const {
+    return root_ == kNull;
+}
+
+template <typename T, size_t Capacity>
+void StaticAdvancedVector<T, Capacity>::clear() {
+    Free(root_);
+    root_ = kNull;
+}
+
+template <typename T, size_t Capacity>
+const T& StaticAdvancedVector<T, Capacity>::operator[](size_t index) const {
+    return pool_[Find(root_, index)].value_;
+}
+
+template <typename T, size_t Capacity>
+T& StaticAdvancedVector<T, Capacity>::operator[](size_t index) {
+    return pool_[Find(root_, index)].value_;
+}
+
+template <typename T, size_t Capacity>
+const T& StaticAdvancedVector<T, Capacity>::front() const {
+    return operator[](0);
+}
+
+template <typename T, size_t Capacity>
+T& StaticAdvancedVector<T, Capacity>::front() {
+    return operator[](0);
+}
+
+template <typename T, size_t Capacity>
+const T& StaticAdvancedVector<T, Capacity>::back() const {
+    return operator[](size() - 1);
+}
+
+template <typename T, size_t Capacity>
+T& StaticAdvancedVector<T, Capacity>::back() {
+    return operator[](size() - 1);
+}
+
+template <typename T, size_t Capacity>
+void StaticAdvancedVector<T, Capacity>::push_back(const T& value) {
+    insert(size(), value);
+}
+
+template <typename T, size_t Capacity>
+void StaticAdvancedVector<T, Capacity>::push_front(const T& value) {
+    insert(0, value);
+}
+
+template <typename T, size_t Capacity>
+void StaticAdvancedVector<T, Capacity>::insert(size_t position, const T& value) {
+    index_type node = Allocate(value, static_cast<uint32_t>(gen_()));
+    auto [split_first, split_second] = Split(root_, position);
+    root_ = Merge(Merge(split_first, node), split_second);
+}
+
+template <typename T, size_t Capacity>
+void StaticAdvancedVector<T, Capacity>::erase(size_t position) {
+    if (position < size()) {
+        erase(position, 1);
+    }
+}
+
+template <typename T, size_t Capacity>
+void StaticAdvancedVector<T, Capacity>::erase(size_t position, size_t length) {
+    auto [head, rest] = Split(root_, position);
+    auto [erased, tail] = Split(rest, length);
+    Free(erased);
+    root_ = Merge(head, tail);
+}
+
+template <typename T, size_t Capacity>
+void StaticAdvancedVector<T, Capacity>::insert(size_t position, const StaticAdvancedVector<T, Capacity>& data) {
+    Reserve(data.size());
+    index_type copy = CopyFrom(data, data.root_);
+    auto [split_first, split_second] = Split(root_, position);
+    root_ = Merge(Merge(split_first, copy), split_second);
+}
+
+template <typename T, size_t Capacity>
+StaticAdvancedVector<T, Capacity>&
+StaticAdvancedVector<T, Capacity>::operator+=(const StaticAdvancedVector<T, Capacity>& rhs) {
+    insert(size(), rhs);
+    return *this;
+}
+
+template <typename T, size_t Capacity>
+StaticAdvancedVector<T, Capacity>
+StaticAdvancedVector<T, Capacity>::cut_subarray(size_t position, size_t length) {
+    StaticAdvancedVector<T, Capacity> result = copy_subarray(position, length);
+    erase(position, length);
+    return result;
+}
+
+template <typename T, size_t Capacity>
+StaticAdvancedVector<T, Capacity>
+StaticAdvancedVector<T, Capacity>::copy_subarray(size_t position, size_t length) {
+    StaticAdvancedVector<T, Capacity> result;
+    auto [head, rest] = Split(root_, position);
+    auto [subarray, tail] = Split(rest, length);
+    result.root_ = result.CopyFrom(*this, subarray);
+    root_ = Merge(Merge(head, subarray), tail);
+    return result;
+}
+
+template <typename T, size_t Capacity>
+void StaticAdvancedVector<T, Capacity>::move_subarray(size_t position, size_t length, size_t destination) {
+    auto [head, rest] = Split(root_, position);
+    auto [moved, tail] = Split(rest, length);
+    auto [before, after] = Split(Merge(head, tail), destination);
+    root_ = Merge(Merge(before, moved), after);
+}
+
+template <typename T, size_t Capacity>
+bool StaticAdvancedVector<T, Capacity>::operator==(const StaticAdvancedVector<T, Capacity>& other) const {
+    if (size() != other.size()) {
+        return false;
+    }
+    // position-by-position lookups: O(n log n) without any buffer, the shapes of the pools differ
+    for (size_t index = 0; index < size(); ++index) {
+        if (!(pool_[Find(root_, index)].value_ == other.pool_[other.Find(other.root_, index)].value_)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T, size_t Capacity>
+std::vector<T> StaticAdvancedVector<T, Capacity>::to_vector() const {
+    std::vector<T> result;
+    result.reserve(size());
+    copy_to(std::back_inserter(result));
+    return result;
+}
+
+template <typename T, size_t Capacity>
+template <typename OutputIt>
+OutputIt StaticAdvancedVector<T, Capacity>::copy_to(OutputIt destination) const {
+    auto visitor = [&destination](const T& value) {
+        *destination = value;
+        ++destination;
+    };
+    VisitInOrder(root_, visitor);
+    return destination;
+}
+
+template <typename T, size_t Capacity>
+std::ostream&
+operator<<(std::ostream& output_stream, const StaticAdvancedVector<T, Capacity>& data) {
+    data.copy_to(std::ostream_iterator<T>(output_stream, " "));
+    return output_stream;
+}
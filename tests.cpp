@@ -2,10 +2,27 @@
 #include <random>
 #include <vector>
 #include <deque>
+#include <map>
 #include <iterator>
 #include <algorithm>
+#include <thread>
+#include <numeric>
+#include <sstream>
 
 #include <decartian.hpp>
+#include <rope.hpp>
+#include <static_advanced_vector.hpp>
+#include <small_advanced_vector.hpp>
+#include <adaptive_vector.hpp>
+#include <headers/fenwick_tree.hpp>
+#include <headers/blocked_fenwick_tree.hpp>
+#include <headers/huge_page_allocator.hpp>
+#include <headers/fenwick_tree_nd.hpp>
+#include <headers/concurrent_fenwick_tree.hpp>
+#include <headers/mapped_fenwick_tree.hpp>
+#include <headers/sparse_fenwick_tree.hpp>
+#include <headers/segment_tree.hpp>
+#include <headers/cartesian_tree.hpp>
 
 #include <gtest/gtest.h>
 
@@ -264,4 +281,1566 @@ namespace Test {
             EXPECT_EQ(ptr1 - ptr2, t1 - t2);
         }
     }
+    TEST(AdvancedVector, SaveLoad) {
+        AdvancedVector<int> a;
+        for (int i = 0; i < 1000; ++i) {
+            a.insert(rand() % (a.size() + 1), i);
+        }
+
+        std::stringstream stream;
+        a.save(stream);
+        std::string snapshot = stream.str();
+
+        AdvancedVector<int> b = {1, 2, 3};
+        b.load(stream);
+        EXPECT_EQ(a, b);
+
+        std::stringstream second_stream;
+        b.save(second_stream);
+        EXPECT_EQ(second_stream.str(), snapshot);
+
+        auto [values, count] = AdvancedVector<int>::flat_values(snapshot.data(), snapshot.size());
+        ASSERT_EQ(count, a.size());
+        for (size_t i = 0; i < count; ++i) {
+            EXPECT_EQ(values[i], a[i]);
+        }
+
+        AdvancedVector<int> c;
+        c.load(snapshot.data(), snapshot.size());
+        EXPECT_EQ(a, c);
+
+        AdvancedVector<int> empty;
+        std::stringstream empty_stream;
+        empty.save(empty_stream);
+        c.load(empty_stream);
+        EXPECT_TRUE(c.empty());
+
+        EXPECT_THROW(AdvancedVector<long long>::flat_values(snapshot.data(), snapshot.size()), std::runtime_error);
+        EXPECT_THROW(c.load(snapshot.data(), snapshot.size() - 1), std::runtime_error);
+        snapshot[0] = 'X';
+        EXPECT_THROW(c.load(snapshot.data(), snapshot.size()), std::runtime_error);
+    }
+
+    TEST(AdvancedVector, FlattenAndSpans) {
+        std::vector<int> expected;
+        AdvancedVector<int> a;
+        for (int i = 0; i < 500; ++i) {
+            int pos = rand() % (a.size() + 1);
+            a.insert(pos, i);
+            expected.insert(expected.begin() + pos, i);
+        }
+        EXPECT_EQ(a.to_vector(), expected);
+
+        std::vector<int> copied;
+        a.copy_to(std::back_inserter(copied));
+        EXPECT_EQ(copied, expected);
+
+        EXPECT_FALSE(a.is_compacted());
+        EXPECT_THROW(a.as_span(0, 1), std::logic_error);
+
+        a.compact();
+        EXPECT_TRUE(a.is_compacted());
+        auto span = a.as_span(100, 50);
+        ASSERT_EQ(span.size(), 50u);
+        EXPECT_TRUE(std::equal(span.begin(), span.end(), expected.begin() + 100));
+        EXPECT_EQ(a.as_span(500, 0).size(), 0u);
+        EXPECT_THROW(a.as_span(499, 2), std::range_error);
+
+        const auto& const_a = a;
+        EXPECT_EQ(const_a[10], expected[10]);
+        EXPECT_TRUE(a.is_compacted());
+
+        a.push_back(1000);
+        expected.push_back(1000);
+        EXPECT_FALSE(a.is_compacted());
+        EXPECT_THROW(a.as_span(0, 1), std::logic_error);
+        EXPECT_EQ(a.to_vector(), expected);
+
+        a.compact();
+        a[0] = -1;
+        EXPECT_FALSE(a.is_compacted());
+
+        std::stringstream stream;
+        stream << AdvancedVector<int>({1, 2, 3});
+        EXPECT_EQ(stream.str(), "1 2 3 ");
+    }
+
+    template <typename Vector>
+    class AdvancedVectorStorage : public testing::Test {};
+
+    using AdvancedVectorStorages = testing::Types<AdvancedVector<int>,
+                                                  AdvancedVector<int, std::mt19937_64, UniqueNodeStorage>>;
+    TYPED_TEST_SUITE(AdvancedVectorStorage, AdvancedVectorStorages);
+
+    TYPED_TEST(AdvancedVectorStorage, RandomOperations) {
+        std::mt19937 gen(11);
+        std::vector<int> expected;
+        TypeParam a;
+
+        for (int step = 0; step < 3000; ++step) {
+            int kind = gen() % 8;
+            unsigned pos = gen() % (expected.size() + 1);
+            if (kind < 3) {
+                a.insert(pos, step);
+                expected.insert(expected.begin() + pos, step);
+            } else if (kind == 3 && !expected.empty()) {
+                pos = gen() % expected.size();
+                a.erase(pos);
+                expected.erase(expected.begin() + pos);
+            } else if (kind == 4) {
+                unsigned length = gen() % 10;
+                auto cut = a.cut_subarray(pos, length);
+                unsigned end = std::min<size_t>(pos + length, expected.size());
+                EXPECT_EQ(cut.to_vector(), std::vector<int>(expected.begin() + pos, expected.begin() + end));
+                unsigned back = gen() % (a.size() + 1);
+                a.insert(back, std::move(cut));
+                std::vector<int> moved(expected.begin() + pos, expected.begin() + end);
+                expected.erase(expected.begin() + pos, expected.begin() + end);
+                expected.insert(expected.begin() + back, moved.begin(), moved.end());
+            } else if (kind == 5) {
+                auto copy = a.copy_subarray(pos, 5);
+                a.insert(0, copy);
+                unsigned end = std::min<size_t>(pos + 5, expected.size());
+                std::vector<int> copied(expected.begin() + pos, expected.begin() + end);
+                expected.insert(expected.begin(), copied.begin(), copied.end());
+            } else if (kind == 6 && !expected.empty()) {
+                pos = gen() % expected.size();
+                a[pos] = -step;
+                expected[pos] = -step;
+            } else if (kind == 7 && !expected.empty()) {
+                unsigned length = gen() % 20;
+                a.erase(std::min<size_t>(pos, expected.size() - 1), length);
+                pos = std::min<size_t>(pos, expected.size() - 1);
+                expected.erase(expected.begin() + pos,
+                               expected.begin() + std::min<size_t>(pos + length, expected.size()));
+            }
+            ASSERT_EQ(a.size(), expected.size());
+        }
+        EXPECT_EQ(a.to_vector(), expected);
+        for (size_t i = 0; i < expected.size(); i += 7) {
+            EXPECT_EQ(static_cast<const TypeParam&>(a)[i], expected[i]);
+        }
+
+        TypeParam copy(a);
+        copy.push_front(-1);
+        copy.push_back(-2);
+        EXPECT_EQ(copy.size(), a.size() + 2);
+        EXPECT_EQ(copy.front(), -1);
+        EXPECT_EQ(copy.back(), -2);
+
+        TypeParam doubled = a * 2;
+        a += a;
+        EXPECT_EQ(a, doubled);
+        EXPECT_EQ(a.size(), 2 * expected.size());
+
+        TypeParam moved(std::move(a));
+        EXPECT_TRUE(a.empty());
+        EXPECT_EQ(moved, doubled);
+    }
+
+    TYPED_TEST(AdvancedVectorStorage, SnapshotsAndCompaction) {
+        TypeParam a({5, 4, 3, 2, 1});
+        std::stringstream stream;
+        a.save(stream);
+        TypeParam b;
+        b.load(stream);
+        EXPECT_EQ(a, b);
+        EXPECT_EQ(a, AdvancedVector<int>({5, 4, 3, 2, 1}));
+        EXPECT_EQ(AdvancedVector<int>({5, 4, 3, 2, 1}), b);
+
+        b.compact();
+        auto span = b.as_span(1, 3);
+        EXPECT_EQ(std::vector<int>(span.begin(), span.end()), std::vector<int>({4, 3, 2}));
+
+        std::stringstream printed;
+        printed << b;
+        EXPECT_EQ(printed.str(), "5 4 3 2 1 ");
+
+        b.clear();
+        EXPECT_TRUE(b.empty());
+        EXPECT_FALSE(b.is_compacted());
+    }
+
+    TYPED_TEST(AdvancedVectorStorage, SplitAtAndConcat) {
+        std::mt19937 gen(17);
+        for (size_t n : {0, 1, 10, 1000}) {
+            std::vector<int> expected(n);
+            std::iota(expected.begin(), expected.end(), 0);
+            TypeParam a(expected.begin(), expected.end());
+
+            std::vector<size_t> cuts;
+            for (int i = 0; i < 40; ++i) {
+                cuts.push_back(gen() % (n + 1));
+            }
+            cuts.push_back(0);
+            cuts.push_back(n);
+            std::sort(cuts.begin(), cuts.end());
+
+            auto pieces = a.split_at(cuts);
+            EXPECT_TRUE(a.empty());
+            ASSERT_EQ(pieces.size(), cuts.size() + 1);
+            size_t begin = 0;
+            for (size_t i = 0; i < pieces.size(); ++i) {
+                size_t end = i < cuts.size() ? cuts[i] : n;
+                EXPECT_EQ(pieces[i].to_vector(),
+                          std::vector<int>(expected.begin() + begin, expected.begin() + end));
+                begin = end;
+            }
+
+            auto joined = TypeParam::concat(std::move(pieces));
+            EXPECT_EQ(joined.to_vector(), expected);
+            joined.insert(n / 2, -1);
+            expected.insert(expected.begin() + n / 2, -1);
+            EXPECT_EQ(joined.to_vector(), expected);
+        }
+
+        TypeParam b({1, 2, 3});
+        EXPECT_THROW(b.split_at({2, 1}), std::range_error);
+        EXPECT_THROW(b.split_at({4}), std::range_error);
+        EXPECT_EQ(b.size(), 3u);
+        EXPECT_TRUE(TypeParam::concat({}).empty());
+    }
+
+    TEST(AdvancedVector, SplitAtKeepsIterators) {
+        AdvancedVector<int> a;
+        for (int i = 0; i < 300; ++i) {
+            a.push_back(i);
+        }
+        auto pieces = a.split_at({100, 150, 150, 299});
+        std::vector<int> walked;
+        std::copy(pieces[1].begin(), pieces[1].end(), std::back_inserter(walked));
+        std::vector<int> expected(50);
+        std::iota(expected.begin(), expected.end(), 100);
+        EXPECT_EQ(walked, expected);
+        EXPECT_TRUE(pieces[2].begin() == pieces[2].end());
+        EXPECT_EQ(pieces[4].end() - pieces[4].begin(), 1);
+    }
+
+    TYPED_TEST(AdvancedVectorStorage, SortAndMergeSorted) {
+        std::mt19937 gen(23);
+        std::vector<int> values(5000);
+        for (auto& value : values) {
+            value = gen() % 1000;
+        }
+        TypeParam a(values.begin(), values.end());
+        a.sort();
+        std::sort(values.begin(), values.end());
+        EXPECT_EQ(a.to_vector(), values);
+
+        a.sort(std::greater<int>());
+        std::sort(values.begin(), values.end(), std::greater<int>());
+        EXPECT_EQ(a.to_vector(), values);
+        a.sort();
+        std::sort(values.begin(), values.end());
+
+        for (size_t m : {0, 1, 7, 300, 5000}) {
+            std::vector<int> other_values(m);
+            for (auto& value : other_values) {
+                value = gen() % 1200;
+            }
+            std::sort(other_values.begin(), other_values.end());
+            TypeParam other(other_values.begin(), other_values.end());
+
+            std::vector<int> expected;
+            std::merge(values.begin(), values.end(), other_values.begin(), other_values.end(),
+                       std::back_inserter(expected));
+            TypeParam merged = a;
+            merged.merge_sorted(other);
+            EXPECT_EQ(merged.to_vector(), expected);
+            EXPECT_EQ(other.size(), m);
+
+            std::vector<int> merged_twice;
+            std::merge(other_values.begin(), other_values.end(), expected.begin(), expected.end(),
+                       std::back_inserter(merged_twice));
+            other.merge_sorted(std::move(merged));
+            EXPECT_EQ(other.to_vector(), merged_twice);
+            EXPECT_TRUE(merged.empty());
+        }
+    }
+
+    TYPED_TEST(AdvancedVectorStorage, SortedModeQueries) {
+        std::mt19937 gen(31);
+        TypeParam a;
+        std::vector<int> expected;
+        for (int step = 0; step < 3000; ++step) {
+            int value = gen() % 500;
+            size_t position = a.insert_sorted(value);
+            auto bound = std::upper_bound(expected.begin(), expected.end(), value);
+            EXPECT_EQ(position, static_cast<size_t>(bound - expected.begin()));
+            expected.insert(bound, value);
+
+            int probe = static_cast<int>(gen() % 520) - 10;
+            EXPECT_EQ(a.lower_bound(probe),
+                      static_cast<size_t>(std::lower_bound(expected.begin(), expected.end(), probe) - expected.begin()));
+            EXPECT_EQ(a.upper_bound(probe),
+                      static_cast<size_t>(std::upper_bound(expected.begin(), expected.end(), probe) - expected.begin()));
+        }
+        EXPECT_EQ(a.to_vector(), expected);
+
+        auto tail = a.split_by_value(250);
+        auto middle = std::lower_bound(expected.begin(), expected.end(), 250);
+        EXPECT_EQ(a.to_vector(), std::vector<int>(expected.begin(), middle));
+        EXPECT_EQ(tail.to_vector(), std::vector<int>(middle, expected.end()));
+        EXPECT_TRUE(tail.split_by_value(1000).empty());
+        EXPECT_EQ(tail.split_by_value(-1).size(), expected.end() - middle);
+        EXPECT_TRUE(tail.empty());
+
+        // a leaderboard ranked by descending score
+        TypeParam board;
+        for (int score : {30, 10, 50, 20, 50, 40}) {
+            board.insert_sorted(score, std::greater<int>());
+        }
+        EXPECT_EQ(board.to_vector(), (std::vector<int>{50, 50, 40, 30, 20, 10}));
+        EXPECT_EQ(board.lower_bound(40, std::greater<int>()), 2u);
+        EXPECT_EQ(board.insert_sorted(50, std::greater<int>()), 2u);
+    }
+
+    TYPED_TEST(AdvancedVectorStorage, DegenerateTreeTeardown) {
+        // a snapshot with increasing priorities loads as a single left spine of depth n
+        const size_t n = 200000;
+        std::vector<int> values(n);
+        std::iota(values.begin(), values.end(), 0);
+        std::stringstream snapshot;
+        TypeParam(values.begin(), values.end()).save(snapshot);
+        std::string bytes = snapshot.str();
+        AdvancedVectorFlatHeader header;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        for (uint64_t i = 0; i < n; ++i) {
+            std::memcpy(&bytes[header.priorities_offset + i * sizeof(uint64_t)], &i, sizeof(i));
+        }
+
+        TypeParam a;
+        a.load(bytes.data(), bytes.size());
+        EXPECT_EQ(a.size(), n);
+        a.clear();
+        EXPECT_TRUE(a.empty());
+
+        a.load(bytes.data(), bytes.size());
+        a.set_deferred_reclamation(true);
+        a.clear();
+        DeferredReclaimer::Instance().Drain();
+        EXPECT_EQ(DeferredReclaimer::Instance().Pending(), 0u);
+
+        TypeParam b;
+        b.load(bytes.data(), bytes.size());
+    }
+
+    TEST(AdvancedVector, DeferredReclamation) {
+        std::vector<int> values(10000);
+        std::iota(values.begin(), values.end(), 0);
+        AdvancedVector<int> a(values.begin(), values.end());
+        a.set_deferred_reclamation(true);
+
+        auto kept = std::next(a.begin(), 100);
+        auto erased = std::next(a.begin(), 5000);
+        std::vector<AdvancedVector<int>::handle_t> erased_handles;
+        for (unsigned i = 1000; i < 9000; i += 7) {
+            erased_handles.push_back(a.handle_at(i));
+        }
+        auto kept_handle = a.handle_at(9500);
+        a.erase(1000, 8000);
+        values.erase(values.begin() + 1000, values.begin() + 9000);
+        // the worker tears the range down meanwhile, lookups must neither race with it nor
+        // mistake the dropped subtree for another vector
+        auto expect_erased = [](auto lookup) {
+            try {
+                lookup();
+                ADD_FAILURE() << "no exception";
+            } catch (const std::invalid_argument& error) {
+                EXPECT_NE(std::string(error.what()).find("erased"), std::string::npos) << error.what();
+            }
+        };
+        for (const auto& handle : erased_handles) {
+            expect_erased([&]() { a.position(handle); });
+            expect_erased([&]() { a.precedes(handle, kept_handle); });
+        }
+        DeferredReclaimer::Instance().Drain();
+        expect_erased([&]() { a.position(erased_handles[0]); });
+        EXPECT_EQ(a.position(kept_handle), 1500u);
+
+        EXPECT_EQ(a.to_vector(), values);
+        EXPECT_EQ(*kept, 100);
+        EXPECT_EQ(kept - a.begin(), 100);
+        std::vector<int> walked;
+        std::copy(a.begin(), a.end(), std::back_inserter(walked));
+        EXPECT_EQ(walked, values);
+        // a node referenced by an iterator outlives its subtree
+        EXPECT_EQ(*erased, 5000);
+
+        AdvancedVector<int> copy = a;
+        EXPECT_TRUE(copy.deferred_reclamation());
+        a = AdvancedVector<int>{1, 2, 3};
+        // assignment keeps the setting of the destination
+        EXPECT_TRUE(a.deferred_reclamation());
+        copy.clear();
+        DeferredReclaimer::Instance().Drain();
+        EXPECT_EQ(a.to_vector(), (std::vector<int>{1, 2, 3}));
+        EXPECT_TRUE(copy.empty());
+
+        // load and *= replace the whole tree through the reclaimer as well: iterators keep every old
+        // node alive, and handles into the old tree must still report the elements as erased
+        std::stringstream snapshot;
+        AdvancedVector<int>(values.begin(), values.end()).save(snapshot);
+        for (int replacement = 0; replacement < 2; ++replacement) {
+            std::vector<AdvancedVector<int>::iterator> old_nodes;
+            std::vector<AdvancedVector<int>::handle_t> old_handles;
+            for (auto it = a.begin(); it != a.end(); ++it) {
+                old_nodes.push_back(it);
+                old_handles.push_back(a.handle_at(old_handles.size()));
+            }
+            if (replacement == 0) {
+                std::stringstream truncated(snapshot.str().substr(0, snapshot.str().size() / 2));
+                EXPECT_THROW(a.load(truncated), std::runtime_error);
+                EXPECT_EQ(a.position(old_handles.back()), old_handles.size() - 1);
+                a.load(snapshot);
+                EXPECT_EQ(a.to_vector(), values);
+            } else {
+                a *= 2;
+                EXPECT_EQ(a.size(), 2 * old_handles.size());
+            }
+            for (const auto& handle : old_handles) {
+                expect_erased([&]() { a.position(handle); });
+            }
+        }
+        DeferredReclaimer::Instance().Drain();
+    }
+
+    TEST(AdvancedVector, RelayoutKeepsShape) {
+        std::mt19937 gen(37);
+        AdvancedVector<int> a;
+        for (int i = 0; i < 20000; ++i) {
+            a.insert(gen() % (a.size() + 1), i);
+        }
+        for (int i = 0; i < 5000; ++i) {
+            a.erase(gen() % a.size());
+        }
+
+        for (auto layout : {NodeLayout::kPreorder, NodeLayout::kVanEmdeBoas}) {
+            // a snapshot holds the values and priorities in order, which determine the shape
+            std::stringstream before, after;
+            a.save(before);
+            std::vector<int> values = a.to_vector();
+
+            a.relayout(layout);
+            a.save(after);
+            EXPECT_EQ(after.str(), before.str());
+
+            const auto& relaid = a;
+            std::vector<const int*> addresses;
+            for (unsigned i = 0; i < relaid.size(); ++i) {
+                addresses.push_back(&relaid[i]);
+            }
+            auto [lowest, highest] = std::minmax_element(addresses.begin(), addresses.end());
+            EXPECT_LT(size_t(*highest - *lowest), addresses.size() * 256 / sizeof(int));
+
+            // the relaid tree keeps working, with iterators and with new nodes from the heap
+            std::vector<int> walked(a.begin(), a.end());
+            EXPECT_EQ(walked, values);
+            a.insert(100, -1);
+            a.erase(7000, 3000);
+            values.insert(values.begin() + 100, -1);
+            values.erase(values.begin() + 7000, values.begin() + 10000);
+            EXPECT_EQ(a.to_vector(), values);
+        }
+
+        AdvancedVector<std::string> strings = {"a", "b", "c"};
+        strings.relayout(NodeLayout::kPreorder);
+        EXPECT_EQ(strings.to_vector(), (std::vector<std::string>{"a", "b", "c"}));
+        AdvancedVector<int> empty;
+        empty.relayout();
+        EXPECT_TRUE(empty.empty());
+    }
+
+    TEST(AdvancedVector, HandlesFollowElements) {
+        // an order book queue: orders join anywhere, cancel by handle, and the queue is split and joined
+        std::mt19937 gen(41);
+        AdvancedVector<int> queue;
+        std::vector<int> expected;
+        std::vector<AdvancedVector<int>::handle_t> handles;
+        for (int id = 0; id < 3000; ++id) {
+            if (id % 3 == 0 || expected.empty()) {
+                handles.push_back(queue.push_back(id));
+                expected.push_back(id);
+            } else {
+                unsigned position = gen() % (expected.size() + 1);
+                handles.push_back(queue.insert(position, id));
+                expected.insert(expected.begin() + position, id);
+            }
+            if (id % 5 == 4) {
+                int cancelled = expected[gen() % expected.size()];
+                queue.erase(queue.position(handles[cancelled]));
+                expected.erase(std::find(expected.begin(), expected.end(), cancelled));
+                EXPECT_TRUE(handles[cancelled].expired());
+                EXPECT_THROW(queue.position(handles[cancelled]), std::invalid_argument);
+            }
+            if (id % 500 == 499) {
+                auto tail = queue.cut_subarray(expected.size() / 3, expected.size() / 2);
+                EXPECT_THROW(queue.position(handles[tail[0]]), std::invalid_argument);
+                EXPECT_EQ(tail.position(handles[tail[0]]), 0u);
+                queue.insert(expected.size() / 3, std::move(tail));
+                auto pieces = queue.split_at({100, 200, expected.size() - 10});
+                queue = AdvancedVector<int>::concat(std::move(pieces));
+            }
+        }
+        EXPECT_EQ(queue.to_vector(), expected);
+
+        for (size_t i = 0; i < expected.size(); ++i) {
+            EXPECT_EQ(queue.position(handles[expected[i]]), i);
+            EXPECT_EQ(queue.position(queue.handle_at(i)), i);
+        }
+        for (int step = 0; step < 2000; ++step) {
+            size_t first = gen() % expected.size();
+            size_t second = gen() % expected.size();
+            EXPECT_EQ(queue.precedes(handles[expected[first]], handles[expected[second]]), first < second);
+        }
+        AdvancedVector<int> other = {1, 2, 3};
+        EXPECT_THROW(queue.precedes(handles[expected[0]], other.handle_at(0)), std::invalid_argument);
+        EXPECT_THROW(queue.handle_at(expected.size()), std::range_error);
+
+        // sort moves values between nodes: a handle keeps its position, not its value
+        std::vector<size_t> positions(handles.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            positions[expected[i]] = i;
+        }
+        queue.sort();
+        std::sort(expected.begin(), expected.end());
+        EXPECT_EQ(queue.to_vector(), expected);
+        for (size_t value = 0; value < handles.size(); value += 37) {
+            if (handles[value].expired()) {
+                continue;
+            }
+            size_t position = queue.position(handles[value]);
+            EXPECT_EQ(position, positions[value]);
+            EXPECT_EQ(queue[position], expected[position]);
+        }
+    }
+
+    TEST(AdvancedVector, MergeSortedIsStable) {
+        using Item = std::pair<int, int>;
+        auto by_key = [](const Item& lhs, const Item& rhs) { return lhs.first < rhs.first; };
+        std::mt19937 gen(29);
+        std::vector<Item> first, second;
+        for (int i = 0; i < 2000; ++i) {
+            first.emplace_back(gen() % 50, 0);
+            second.emplace_back(gen() % 50, 1);
+        }
+        std::stable_sort(first.begin(), first.end(), by_key);
+        std::stable_sort(second.begin(), second.end(), by_key);
+        std::vector<Item> expected;
+        std::merge(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(expected), by_key);
+
+        AdvancedVector<Item> a(first.begin(), first.end());
+        AdvancedVector<Item> b(second.begin(), second.end());
+        auto iter = a.begin();
+        a.merge_sorted(std::move(b), by_key);
+        EXPECT_EQ(a.to_vector(), expected);
+
+        // iterators follow the nodes, and the nodes keep their values
+        EXPECT_EQ(*iter, first.front());
+        std::vector<Item> walked;
+        std::copy(a.begin(), a.end(), std::back_inserter(walked));
+        EXPECT_EQ(walked, expected);
+    }
+
+    TEST(StaticAdvancedVector, RandomOperations) {
+        std::mt19937 gen(5);
+        std::vector<int> expected;
+        StaticAdvancedVector<int, 600> a;
+        for (int i = 0; i < 300; ++i) {
+            a.push_back(i);
+            expected.push_back(i);
+        }
+
+        for (int step = 0; step < 5000; ++step) {
+            int kind = gen() % 8 - 2;
+            size_t pos = gen() % (expected.size() + 1);
+            if (kind < 2) {
+                if (expected.size() == a.capacity()) {
+                    EXPECT_THROW(a.insert(pos, step), std::length_error);
+                    continue;
+                }
+                a.insert(pos, step);
+                expected.insert(expected.begin() + pos, step);
+            } else if (kind == 2 && !expected.empty()) {
+                pos = gen() % expected.size();
+                a.erase(pos);
+                expected.erase(expected.begin() + pos);
+            } else if (kind == 3) {
+                size_t length = gen() % 8;
+                size_t end = std::min(pos + length, expected.size());
+                a.erase(pos, length);
+                expected.erase(expected.begin() + pos, expected.begin() + end);
+            } else if (kind == 4) {
+                size_t length = gen() % 20;
+                size_t end = std::min(pos + length, expected.size());
+                std::vector<int> moved(expected.begin() + pos, expected.begin() + end);
+                expected.erase(expected.begin() + pos, expected.begin() + end);
+                size_t destination = gen() % (expected.size() + 1);
+                expected.insert(expected.begin() + destination, moved.begin(), moved.end());
+                a.move_subarray(pos, length, destination);
+            } else if (kind == 5 && !expected.empty()) {
+                pos = gen() % expected.size();
+                a[pos] = -step;
+                expected[pos] = -step;
+            }
+            ASSERT_EQ(a.size(), expected.size());
+        }
+        EXPECT_EQ(a.to_vector(), expected);
+
+        auto copy = a.copy_subarray(10, 30);
+        EXPECT_EQ(copy.to_vector(), std::vector<int>(expected.begin() + 10, expected.begin() + 40));
+        auto cut = a.cut_subarray(0, 10);
+        EXPECT_EQ(cut.to_vector(), std::vector<int>(expected.begin(), expected.begin() + 10));
+        a.insert(a.size(), cut);
+        expected.insert(expected.end(), expected.begin(), expected.begin() + 10);
+        expected.erase(expected.begin(), expected.begin() + 10);
+        EXPECT_EQ(a.to_vector(), expected);
+    }
+
+    TEST(StaticAdvancedVector, Capacity) {
+        StaticAdvancedVector<int, 8> a = {1, 2, 3, 4, 5};
+        StaticAdvancedVector<int, 8> b = {6, 7, 8};
+        a += b;
+        EXPECT_TRUE(a == (StaticAdvancedVector<int, 8>{1, 2, 3, 4, 5, 6, 7, 8}));
+        EXPECT_THROW(a.push_back(9), std::length_error);
+        EXPECT_THROW(a.insert(0, b), std::length_error);
+        EXPECT_EQ(a.to_vector(), std::vector<int>({1, 2, 3, 4, 5, 6, 7, 8}));
+        EXPECT_EQ(a.front(), 1);
+        EXPECT_EQ(a.back(), 8);
+
+        a.erase(0, 3);
+        a.push_front(0);
+        a.insert(1, StaticAdvancedVector<int, 8>({9, 10}));
+        EXPECT_EQ(a.to_vector(), std::vector<int>({0, 9, 10, 4, 5, 6, 7, 8}));
+
+        a.clear();
+        EXPECT_TRUE(a.empty());
+        for (int i = 0; i < 8; ++i) {
+            a.push_front(i);
+        }
+        EXPECT_EQ(a.to_vector(), std::vector<int>({7, 6, 5, 4, 3, 2, 1, 0}));
+    }
+
+    TEST(SmallAdvancedVector, InlineAndTree) {
+        std::mt19937 gen(3);
+        std::vector<int> expected;
+        SmallAdvancedVector<int, 8> a;
+        bool was_promoted = false;
+
+        for (int step = 0; step < 4000; ++step) {
+            // drift the size up and down across the inline capacity
+            bool grow = (step / 200) % 2 == 0;
+            size_t pos = gen() % (expected.size() + 1);
+            if (gen() % 3 != 0 ? grow : !grow) {
+                a.insert(pos, step);
+                expected.insert(expected.begin() + pos, step);
+            } else if (!expected.empty()) {
+                pos = gen() % expected.size();
+                size_t length = 1 + gen() % 3;
+                a.erase(pos, length);
+                expected.erase(expected.begin() + pos,
+                               expected.begin() + std::min(pos + length, expected.size()));
+            }
+            ASSERT_EQ(a.size(), expected.size());
+            if (expected.size() <= 4) {
+                ASSERT_TRUE(a.is_inline());
+            } else if (expected.size() > 8) {
+                ASSERT_FALSE(a.is_inline());
+                was_promoted = true;
+            }
+            if (!expected.empty()) {
+                ASSERT_EQ(a[expected.size() / 2], expected[expected.size() / 2]);
+            }
+        }
+        EXPECT_TRUE(was_promoted);
+        EXPECT_EQ(a.to_vector(), expected);
+    }
+
+    TEST(SmallAdvancedVector, Hysteresis) {
+        SmallAdvancedVector<int, 4> a = {1, 2, 3, 4};
+        EXPECT_TRUE(a.is_inline());
+        a.push_back(5);
+        EXPECT_FALSE(a.is_inline());
+
+        // a bad position is rejected before promotion, on both paths
+        SmallAdvancedVector<int, 4> full = {1, 2, 3, 4};
+        EXPECT_THROW(full.insert(5, 0), std::range_error);
+        EXPECT_TRUE(full.is_inline());
+        EXPECT_EQ(full.size(), 4u);
+        EXPECT_THROW(a.insert(6, 0), std::range_error);
+        EXPECT_EQ(a.size(), 5u);
+
+        // alternating around the capacity keeps the tree
+        a.erase(4);
+        a.push_back(5);
+        a.erase(4);
+        EXPECT_FALSE(a.is_inline());
+        a.erase(0);
+        EXPECT_FALSE(a.is_inline());
+        a.erase(0);
+        EXPECT_TRUE(a.is_inline());
+        EXPECT_EQ(a.to_vector(), std::vector<int>({3, 4}));
+
+        auto b = a;
+        b.push_front(0);
+        b.front() = -1;
+        b.back() = 40;
+        EXPECT_EQ(b.to_vector(), std::vector<int>({-1, 3, 40}));
+        EXPECT_EQ(a.to_vector(), std::vector<int>({3, 4}));
+
+        SmallAdvancedVector<int, 4> big = {1, 2, 3, 4, 5, 6};
+        EXPECT_FALSE(big.is_inline());
+        auto big_copy = big;
+        EXPECT_TRUE(big_copy == big);
+        big.clear();
+        EXPECT_TRUE(big.empty());
+        EXPECT_TRUE(big.is_inline());
+        EXPECT_EQ(big_copy.size(), 6u);
+
+        std::stringstream stream;
+        stream << big_copy;
+        EXPECT_EQ(stream.str(), "1 2 3 4 5 6 ");
+    }
+
+    TEST(AdaptiveVector, FollowsWorkload) {
+        std::mt19937 gen(9);
+        std::vector<int> expected(5000);
+        std::iota(expected.begin(), expected.end(), 0);
+        AdaptiveVector<int> a(expected.begin(), expected.end());
+        EXPECT_TRUE(a.is_contiguous());
+
+        // edit-heavy phase moves the elements to the treap
+        for (int step = 0; step < 2000; ++step) {
+            size_t pos = gen() % expected.size();
+            if (step % 2 == 0) {
+                a.insert(pos, -step);
+                expected.insert(expected.begin() + pos, -step);
+            } else {
+                a.erase(pos);
+                expected.erase(expected.begin() + pos);
+            }
+        }
+        EXPECT_FALSE(a.is_contiguous());
+        EXPECT_EQ(a.to_vector(), expected);
+
+        // read-heavy phase through a const reference moves them back at the next decision point
+        const auto& const_reader = a;
+        long long sum = 0;
+        for (int step = 0; step < 20000; ++step) {
+            size_t pos = gen() % expected.size();
+            sum += const_reader[pos] - expected[pos];
+        }
+        EXPECT_EQ(sum, 0);
+        EXPECT_FALSE(a.is_contiguous());
+        a.adapt();
+        EXPECT_TRUE(a.is_contiguous());
+
+        // a few middle edits among many reads keep the vector
+        for (int step = 0; step < 20000; ++step) {
+            size_t pos = gen() % expected.size();
+            if (step % 100 == 0) {
+                a.insert(pos, step);
+                expected.insert(expected.begin() + pos, step);
+            } else {
+                a[pos] += 1;
+                expected[pos] += 1;
+            }
+            ASSERT_TRUE(a.is_contiguous());
+        }
+        EXPECT_EQ(a.to_vector(), expected);
+
+        // const reads are neither counted nor racy: concurrent readers leave the tree in place
+        a.make_tree();
+        const auto& const_a = a;
+        std::vector<long long> sums(2, 0);
+        std::vector<std::thread> readers;
+        for (size_t reader = 0; reader < sums.size(); ++reader) {
+            readers.emplace_back([&const_a, &sums, reader]() {
+                for (unsigned step = 0; step < 20000; ++step) {
+                    sums[reader] += const_a[step % const_a.size()];
+                }
+            });
+        }
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        EXPECT_EQ(sums[0], sums[1]);
+        EXPECT_FALSE(a.is_contiguous());
+        // the counted const reads decide the layout at the next mutation
+        a.insert(0, 0);
+        EXPECT_TRUE(a.is_contiguous());
+    }
+
+    TEST(AdaptiveVector, ReferencesSurviveWindowBoundary) {
+        std::vector<int> expected(100);
+        std::iota(expected.begin(), expected.end(), 0);
+        AdaptiveVector<int> a(expected.begin(), expected.end());
+        a.make_tree();
+        // the second access of the swap completes a read-heavy window
+        for (size_t step = 0; step + 2 < AdaptiveVector<int>::kWindow; ++step) {
+            EXPECT_EQ(a[step % a.size()], expected[step % expected.size()]);
+        }
+        std::swap(a[10], a[90]);
+        std::swap(expected[10], expected[90]);
+        a[20] = a[30];
+        expected[20] = expected[30];
+        EXPECT_FALSE(a.is_contiguous());
+        EXPECT_EQ(a.to_vector(), expected);
+
+        // the decision waits for a mutation
+        a.push_back(100);
+        expected.push_back(100);
+        EXPECT_TRUE(a.is_contiguous());
+        EXPECT_EQ(a.to_vector(), expected);
+    }
+
+    TEST(AdaptiveVector, CutAndConcatenate) {
+        for (bool tree : {false, true}) {
+            AdaptiveVector<int> a = {1, 2, 3, 4, 5, 6, 7, 8};
+            if (tree) {
+                a.make_tree();
+            }
+            auto middle = a.cut_subarray(2, 3);
+            EXPECT_EQ(middle.to_vector(), std::vector<int>({3, 4, 5}));
+            EXPECT_EQ(a.to_vector(), std::vector<int>({1, 2, 6, 7, 8}));
+            EXPECT_EQ(middle.is_contiguous(), !tree);
+
+            AdaptiveVector<int> tail = {9, 10};
+            tail.make_tree();
+            a += std::move(tail);
+            a += std::move(middle);
+            EXPECT_TRUE(tail.empty());
+            EXPECT_EQ(a.to_vector(), std::vector<int>({1, 2, 6, 7, 8, 9, 10, 3, 4, 5}));
+
+            a.erase(0, 100);
+            EXPECT_TRUE(a.empty());
+            EXPECT_THROW(a.insert(1, 0), std::range_error);
+        }
+    }
+
+    TEST(Rope, RandomEdits) {
+        std::mt19937 gen(7);
+        std::string expected;
+        Rope rope;
+        const std::string alphabet = "ab\n";
+        for (int step = 0; step < 3000; ++step) {
+            int kind = gen() % 3;
+            if (kind < 2) {
+                size_t length = step % 50 == 0 ? 700 + gen() % 1000 : gen() % 20;
+                std::string text;
+                for (size_t i = 0; i < length; ++i) {
+                    text.push_back(alphabet[gen() % alphabet.size()]);
+                }
+                size_t pos = gen() % (expected.size() + 1);
+                rope.insert(pos, text);
+                expected.insert(pos, text);
+            } else {
+                size_t pos = gen() % (expected.size() + 1);
+                size_t length = step % 70 == 0 ? 2000 : gen() % 30;
+                rope.erase(pos, length);
+                expected.erase(pos, length);
+            }
+            ASSERT_EQ(rope.size(), expected.size());
+            if (step % 100 == 0) {
+                // short chunks are merged, so the node overhead per byte stays bounded
+                ASSERT_LE(rope.chunks(), expected.size() / Rope::kMinChunkSize + 1);
+            }
+        }
+        EXPECT_EQ(rope.to_string(), expected);
+        EXPECT_LE(rope.chunks(), expected.size() / Rope::kMinChunkSize + 1);
+
+        for (int i = 0; i < 200; ++i) {
+            size_t pos = gen() % (expected.size() + 1);
+            size_t length = gen() % 1500;
+            EXPECT_EQ(rope.substr(pos, length), expected.substr(pos, length));
+            if (pos < expected.size()) {
+                EXPECT_EQ(rope[pos], expected[pos]);
+            }
+        }
+
+        for (int i = 0; i < 200; ++i) {
+            size_t from = gen() % (expected.size() + 1);
+            std::string needle = i % 2 == 0 ? expected.substr(gen() % expected.size(), 1 + gen() % 12)
+                                            : std::string("ab\nba\nab").substr(0, 1 + gen() % 8);
+            EXPECT_EQ(rope.find(needle, from), expected.find(needle, from)) << needle;
+        }
+        EXPECT_EQ(rope.find("c"), Rope::npos);
+        EXPECT_EQ(rope.find("", 5), 5u);
+
+        size_t lines = std::count(expected.begin(), expected.end(), '\n') + 1;
+        ASSERT_EQ(rope.lines(), lines);
+        size_t line = 0;
+        for (size_t pos = 0; pos <= expected.size(); ++pos) {
+            ASSERT_EQ(rope.line_of(pos), line);
+            if (pos == 0 || expected[pos - 1] == '\n') {
+                ASSERT_EQ(rope.line_start(line), pos);
+            }
+            if (pos < expected.size() && expected[pos] == '\n') {
+                ++line;
+            }
+        }
+        EXPECT_THROW(rope.line_start(lines), std::range_error);
+        EXPECT_THROW(rope.insert(expected.size() + 1, "x"), std::range_error);
+    }
+
+    TEST(Rope, LongEditingSessionKeepsChunksLarge) {
+        // inserts one byte longer than a chunk leave a sliver behind every time unless it is merged
+        std::mt19937 gen(36);
+        std::string expected(5000, 'x');
+        Rope rope(expected);
+        for (int step = 0; step < 20000; ++step) {
+            size_t pos = gen() % (expected.size() + 1);
+            size_t length = Rope::kMaxChunkSize + 1 + gen() % 3;
+            if (step % 2 == 0) {
+                std::string text(length, static_cast<char>('a' + step % 26));
+                rope.insert(pos, text);
+                expected.insert(pos, text);
+            } else {
+                rope.erase(pos, length);
+                expected.erase(pos, length);
+            }
+            if (step % 50 == 0) {
+                ASSERT_LE(rope.chunks(), expected.size() / Rope::kMinChunkSize + 1);
+            }
+        }
+        EXPECT_EQ(rope.to_string(), expected);
+        EXPECT_LE(rope.chunks(), expected.size() / Rope::kMinChunkSize + 1);
+
+        // cutting every chunk down to two bytes would keep a node per original chunk
+        const size_t kChunks = 100;
+        Rope eroded(std::string(kChunks * Rope::kMaxChunkSize, 'z'));
+        ASSERT_EQ(eroded.chunks(), kChunks);
+        for (size_t i = 0; i < kChunks; ++i) {
+            eroded.erase(2 * i, Rope::kMaxChunkSize - 2);
+        }
+        EXPECT_EQ(eroded.to_string(), std::string(2 * kChunks, 'z'));
+        EXPECT_LE(eroded.chunks(), 2 * kChunks / Rope::kMinChunkSize + 1);
+        eroded.erase(1, eroded.size() - 2);
+        EXPECT_EQ(eroded.chunks(), 1u);
+    }
+
+    TEST(Rope, FindAcrossChunks) {
+        // periodic text and needles: the quadratic case of naive search, with matches across borders
+        std::string text(20000, 'a');
+        Rope rope;
+        for (size_t pos = 0; pos < text.size(); pos += 97) {
+            rope.append(text.substr(pos, 97));
+        }
+        for (size_t length : {2u, 63u, 511u, 512u, 513u, 3000u}) {
+            std::string needle(length - 1, 'a');
+            needle.push_back('b');
+            EXPECT_EQ(rope.find(needle), Rope::npos);
+            EXPECT_EQ(rope.find(needle.substr(0, length - 1), 1234), 1234u);
+        }
+
+        std::mt19937 gen(35);
+        for (size_t i = 0; i < text.size(); ++i) {
+            text[i] = "ab"[gen() % 7 == 0];
+        }
+        rope = Rope(text);
+        for (int query = 0; query < 300; ++query) {
+            size_t from = gen() % text.size();
+            size_t length = query % 3 == 0 ? 500 + gen() % 1500 : 1 + gen() % 40;
+            std::string needle = text.substr(gen() % text.size(), length);
+            if (query % 5 == 0) {
+                needle.back() = 'c';
+            }
+            EXPECT_EQ(rope.find(needle, from), text.find(needle, from));
+        }
+    }
+
+    TEST(Rope, LongTextAndCopies) {
+        std::string text;
+        for (int i = 0; i < 100000; ++i) {
+            text += "line " + std::to_string(i) + "\n";
+        }
+        // two-byte UTF-8 characters must stay whole inside chunks
+        text += std::string(3000, '\xD0');
+        for (size_t i = text.size() - 3000; i < text.size(); i += 2) {
+            text[i + 1] = '\xB0';
+        }
+        Rope rope(text);
+        EXPECT_EQ(rope.to_string(), text);
+        EXPECT_EQ(rope.lines(), 100001u);
+        EXPECT_EQ(rope.line_start(12345), text.find("line 12345\n"));
+        EXPECT_EQ(rope.find("line 99999\n"), text.find("line 99999\n"));
+
+        Rope copy = rope;
+        copy.erase(0, text.size() - 3000);
+        EXPECT_EQ(copy.to_string(), text.substr(text.size() - 3000));
+        EXPECT_EQ(rope.size(), text.size());
+
+        rope = Rope("first\nsecond");
+        rope.append("\nthird");
+        EXPECT_EQ(rope.to_string(), "first\nsecond\nthird");
+        EXPECT_EQ(rope.line_start(2), 13u);
+        rope.clear();
+        EXPECT_TRUE(rope.empty());
+        EXPECT_EQ(rope.lines(), 1u);
+    }
+
+    TEST(FenwickTreeND, RectangleSums) {
+        const int rows = 13, cols = 7;
+        std::vector<std::vector<long long>> grid(rows, std::vector<long long>(cols, 0));
+        FenwickTreeND<long long, 2> tree({rows, cols});
+
+        for (int i = 0; i < 1000; ++i) {
+            int r = rand() % rows, c = rand() % cols;
+            if (rand() % 2 == 0) {
+                long long delta = rand() % 100 - 50;
+                grid[r][c] += delta;
+                tree.inc({r, c}, delta);
+            } else {
+                int r2 = rand() % rows, c2 = rand() % cols;
+                long long expected = 0;
+                for (int x = std::min(r, r2); x <= std::max(r, r2); ++x) {
+                    for (int y = std::min(c, c2); y <= std::max(c, c2); ++y) {
+                        expected += grid[x][y];
+                    }
+                }
+                EXPECT_EQ(tree.sum({r, c}, {r2, c2}), expected);
+            }
+        }
+
+        tree.set({3, 4}, 42);
+        EXPECT_EQ((tree[{3, 4}]), 42);
+        EXPECT_THROW(tree.inc({rows, 0}, 1), std::range_error);
+    }
+
+    TEST(FenwickTreeND, ThreeDimensions) {
+        FenwickTreeND<int, 3> tree({4, 5, 6});
+        int total = 0;
+        for (int x = 0; x < 4; ++x) {
+            for (int y = 0; y < 5; ++y) {
+                for (int z = 0; z < 6; ++z) {
+                    tree.inc({x, y, z}, x + y + z);
+                    total += x + y + z;
+                }
+            }
+        }
+        EXPECT_EQ(tree.sum({0, 0, 0}, {3, 4, 5}), total);
+        EXPECT_EQ(tree.sum({1, 1, 1}, {1, 1, 2}), 3 + 4);
+        EXPECT_EQ(tree.size(2), 6u);
+    }
+    template <typename T>
+    void CheckFenwickBatches(size_t size, size_t batch) {
+        std::vector<T> values(size);
+        for (auto& value : values) {
+            value = rand() % 100;
+        }
+        FenwickTree<T> tree(values);
+
+        std::vector<int> indices;
+        std::vector<T> deltas;
+        for (size_t i = 0; i < batch; ++i) {
+            indices.push_back(rand() % size);
+            deltas.push_back(rand() % 100 - 50);
+            values[indices.back()] += deltas.back();
+        }
+        tree.inc_batch(indices, deltas);
+
+        std::vector<std::pair<int, int>> ranges;
+        for (size_t i = 0; i < batch + 3; ++i) {
+            ranges.emplace_back(rand() % size, rand() % size);
+        }
+        std::vector<T> sums;
+        tree.sum_batch(ranges, sums);
+
+        ASSERT_EQ(sums.size(), ranges.size());
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            int left = std::min(ranges[i].first, ranges[i].second);
+            int right = std::max(ranges[i].first, ranges[i].second);
+            T expected = 0;
+            for (int j = left; j <= right; ++j) {
+                expected += values[j];
+            }
+            EXPECT_EQ(sums[i], expected);
+            EXPECT_EQ(sums[i], tree.sum(left, right));
+        }
+    }
+
+    TEST(FenwickTree, Batches) {
+        CheckFenwickBatches<int>(1000, 10);
+        CheckFenwickBatches<int>(100, 500);
+        CheckFenwickBatches<long long>(1000, 10);
+        CheckFenwickBatches<long long>(100, 500);
+        CheckFenwickBatches<double>(777, 61);
+
+        FenwickTree<int> tree(10);
+        EXPECT_THROW(tree.inc_batch({1, 2}, {1}), std::logic_error);
+        EXPECT_THROW(tree.inc_batch({10}, {1}), std::range_error);
+    }
+    template <FenwickConcurrency Mode>
+    void CheckConcurrentFenwickTree() {
+        const int size = 1000, threads = 8, increments = 20000;
+        ConcurrentFenwickTree<long long, Mode> tree(size, 4);
+
+        std::vector<std::thread> workers;
+        for (int worker = 0; worker < threads; ++worker) {
+            workers.emplace_back([&tree, worker]() {
+                for (int i = 0; i < increments; ++i) {
+                    tree.inc((worker * 7919 + i) % size, 1);
+                }
+            });
+        }
+        for (auto& thread : workers) {
+            thread.join();
+        }
+
+        EXPECT_EQ(tree.sum(0, size - 1), threads * increments);
+        long long total = 0;
+        for (int i = 0; i < size; ++i) {
+            total += tree[i];
+        }
+        EXPECT_EQ(total, threads * increments);
+        EXPECT_THROW(tree.inc(size, 1), std::range_error);
+    }
+
+    TEST(ConcurrentFenwickTree, AtomicAndSharded) {
+        CheckConcurrentFenwickTree<FenwickConcurrency::atomic>();
+        CheckConcurrentFenwickTree<FenwickConcurrency::sharded>();
+
+        ConcurrentFenwickTree<double, FenwickConcurrency::sharded> tree(10);
+        tree.inc(3, 0.5);
+        tree.inc(4, 0.25);
+        EXPECT_DOUBLE_EQ(tree.sum(0, 9), 0.75);
+    }
+    TEST(FenwickTree, PointValues) {
+        std::vector<int> values(1000);
+        for (auto& value : values) {
+            value = rand() % 1000 - 500;
+        }
+        FenwickTree<int> tree(values);
+
+        for (int i = 0; i < 5000; ++i) {
+            int index = rand() % values.size();
+            if (rand() % 2 == 0) {
+                values[index] = rand() % 1000;
+                tree.set(index, values[index]);
+            }
+            EXPECT_EQ(tree[index], values[index]);
+        }
+        for (size_t i = 0; i < values.size(); ++i) {
+            EXPECT_EQ(tree[i], values[i]);
+        }
+        EXPECT_THROW(tree[values.size()], std::range_error);
+    }
+    TEST(FenwickTree, Growth) {
+        std::vector<long long> values;
+        FenwickTree<long long> tree(0);
+        tree.reserve(16);
+
+        for (int i = 0; i < 1000; ++i) {
+            values.push_back(rand() % 100);
+            tree.push_back(values.back());
+            ASSERT_EQ(tree.size(), values.size());
+
+            int left = rand() % values.size(), right = rand() % values.size();
+            long long expected = 0;
+            for (int j = std::min(left, right); j <= std::max(left, right); ++j) {
+                expected += values[j];
+            }
+            EXPECT_EQ(tree.sum(left, right), expected);
+        }
+
+        tree.resize(300);
+        values.resize(300);
+        tree.resize(700);
+        values.resize(700, 0);
+        tree.inc(650, 5);
+        values[650] += 5;
+        for (size_t i = 0; i < values.size(); ++i) {
+            EXPECT_EQ(tree[i], values[i]);
+        }
+        EXPECT_EQ(tree.sum(0, 699), std::accumulate(values.begin(), values.end(), 0LL));
+    }
+    TEST(FenwickTree, Operations) {
+        std::vector<unsigned> bits(500);
+        std::vector<int> levels(500);
+        for (size_t i = 0; i < bits.size(); ++i) {
+            bits[i] = rand();
+            levels[i] = rand() % 1000 - 500;
+        }
+        std::vector<int> initial_levels = levels;
+        FenwickTree<unsigned, FenwickXor<unsigned>> xors(bits);
+        FenwickTree<int, FenwickMax<int>> maxima(levels);
+        FenwickTree<int, FenwickMin<int>> minima(levels.size());
+        for (size_t i = 0; i < levels.size(); ++i) {
+            minima.inc(i, levels[i]);
+        }
+
+        for (int step = 0; step < 2000; ++step) {
+            int index = rand() % bits.size();
+            if (step % 2 == 0) {
+                unsigned mask = rand();
+                bits[index] ^= mask;
+                xors.inc(index, mask);
+                // max and min trees take values that only move their element towards the extreme
+                int level = rand() % 1000 - 500;
+                levels[index] = std::max(levels[index], level);
+                maxima.inc(index, level);
+            } else {
+                bits[index] = rand();
+                xors.set(index, bits[index]);
+            }
+
+            int left = rand() % bits.size(), right = rand() % bits.size();
+            unsigned expected_xor = 0;
+            for (int j = std::min(left, right); j <= std::max(left, right); ++j) {
+                expected_xor ^= bits[j];
+            }
+            EXPECT_EQ(xors.sum(left, right), expected_xor);
+            EXPECT_EQ(xors[index], bits[index]);
+            EXPECT_EQ(maxima.prefix(right), *std::max_element(levels.begin(), levels.begin() + right + 1));
+        }
+
+        int running_min = std::numeric_limits<int>::max();
+        for (size_t i = 0; i < initial_levels.size(); ++i) {
+            running_min = std::min(running_min, initial_levels[i]);
+            EXPECT_EQ(minima.prefix(i), running_min);
+        }
+        maxima.resize(600);
+        EXPECT_EQ(maxima.prefix(599), *std::max_element(levels.begin(), levels.end()));
+        // enough updates for the batch to rebuild the tree of deltas
+        std::vector<int> indices(400), deltas(400);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            indices[i] = rand() % 600;
+            deltas[i] = rand() % 2000 - 1000;
+            if (indices[i] < 500) {
+                levels[indices[i]] = std::max(levels[indices[i]], deltas[i]);
+            } else {
+                levels.push_back(deltas[i]);
+            }
+        }
+        maxima.inc_batch(indices, deltas);
+        for (int right : {0, 100, 499}) {
+            EXPECT_EQ(maxima.prefix(right), *std::max_element(levels.begin(), levels.begin() + right + 1));
+        }
+        EXPECT_EQ(maxima.prefix(599), *std::max_element(levels.begin(), levels.end()));
+        EXPECT_THROW(maxima.prefix(600), std::range_error);
+    }
+    template <typename Blocked, typename Plain>
+    void CheckBlockedFenwickTree(size_t size, int steps) {
+        std::vector<long long> values(size);
+        for (auto& value : values) {
+            value = rand() % 1000 - 500;
+        }
+        Blocked blocked(values);
+        Plain plain(values);
+        ASSERT_EQ(blocked.size(), size);
+
+        for (int step = 0; step < steps; ++step) {
+            int index = rand() % size;
+            if (step % 3 == 0) {
+                long long value = rand() % 1000;
+                blocked.set(index, value);
+                plain.set(index, value);
+            } else {
+                long long delta = rand() % 100 - 50;
+                blocked.inc(index, delta);
+                plain.inc(index, delta);
+            }
+            int left = rand() % size, right = rand() % size;
+            ASSERT_EQ(blocked.sum(left, right), plain.sum(left, right));
+            ASSERT_EQ(blocked.prefix(right), plain.prefix(right));
+            ASSERT_EQ(blocked[index], plain[index]);
+        }
+        EXPECT_THROW(blocked.inc(size, 1), std::range_error);
+        EXPECT_THROW(blocked.sum(-1, 0), std::range_error);
+    }
+
+    TEST(BlockedFenwickTree, MatchesFenwickTree) {
+        for (size_t size : {1u, 7u, 8u, 9u, 64u, 1000u}) {
+            CheckBlockedFenwickTree<BlockedFenwickTree<long long>, FenwickTree<long long>>(size, 2000);
+        }
+        // a few MB, so both trees take the mmap path of the allocator
+        CheckBlockedFenwickTree<BlockedFenwickTree<long long, FenwickSum<long long>, HugePageAllocator<long long>>,
+                                FenwickTree<long long, FenwickSum<long long>, HugePageAllocator<long long>>>(
+                1 << 19, 20000);
+
+        BlockedFenwickTree<int> empty(0);
+        EXPECT_EQ(empty.size(), 0u);
+        EXPECT_THROW(empty.prefix(0), std::range_error);
+
+        std::vector<int> levels(300);
+        for (auto& level : levels) {
+            level = rand() % 1000 - 500;
+        }
+        BlockedFenwickTree<int, FenwickMax<int>> maxima(levels);
+        BlockedFenwickTree<char, FenwickXor<char>> bytes(100);
+        for (int step = 0; step < 1000; ++step) {
+            int index = rand() % levels.size();
+            int level = rand() % 1000 - 500;
+            levels[index] = std::max(levels[index], level);
+            maxima.inc(index, level);
+            int right = rand() % levels.size();
+            ASSERT_EQ(maxima.prefix(right), *std::max_element(levels.begin(), levels.begin() + right + 1));
+
+            bytes.set(index % 100, char(step));
+            ASSERT_EQ(bytes[index % 100], char(step));
+        }
+    }
+    TEST(SparseFenwickTree, RandomUpdatesOverFullRange) {
+        SparseFenwickTree<long long> tree;
+        std::map<uint64_t, long long> values;
+        std::mt19937_64 gen(48);
+        const uint64_t top = std::numeric_limits<uint64_t>::max() - 1;
+        const int updates = 3000;
+        auto prefix = [&values](uint64_t right) {
+            long long result = 0;
+            for (auto it = values.begin(); it != values.end() && it->first <= right; ++it) {
+                result += it->second;
+            }
+            return result;
+        };
+
+        for (int step = 0; step < updates; ++step) {
+            // a few clustered indices and the edges of the range, the rest spread over 64 bits
+            uint64_t index = step % 3 == 0 ? gen() % 1000 : gen() % tree.size();
+            if (step % 97 == 0) {
+                index = top - gen() % 4;
+            }
+            long long delta = static_cast<long long>(gen() % 1000);
+            tree.inc(index, delta);
+            values[index] += delta;
+
+            if (step % 50 == 0) {
+                uint64_t left = gen() % tree.size(), right = gen() % tree.size();
+                long long expected = prefix(std::max(left, right)) - prefix(std::min(left, right));
+                expected += values.count(std::min(left, right)) ? values[std::min(left, right)] : 0;
+                EXPECT_EQ(tree.sum(left, right), expected);
+                EXPECT_EQ(tree[index], values[index]);
+            }
+        }
+        EXPECT_EQ(tree.sum(0, top), prefix(top));
+        EXPECT_LE(tree.nodes(), size_t(updates) * 64);
+
+        // lower_bound on a non-negative array: the first index reaching the prefix sum
+        long long total = prefix(top);
+        for (int query = 0; query < 200; ++query) {
+            long long target = static_cast<long long>(gen() % total) + 1;
+            long long running = 0;
+            uint64_t expected = tree.size();
+            for (const auto& [index, value] : values) {
+                running += value;
+                if (running >= target) {
+                    expected = index;
+                    break;
+                }
+            }
+            EXPECT_EQ(tree.lower_bound(target), expected);
+        }
+        EXPECT_EQ(tree.lower_bound(0), 0u);
+        EXPECT_EQ(tree.lower_bound(total + 1), tree.size());
+        EXPECT_THROW(tree.inc(tree.size(), 1), std::range_error);
+        EXPECT_THROW(tree.sum(0, tree.size()), std::range_error);
+
+        tree.clear();
+        EXPECT_EQ(tree.nodes(), 0u);
+        EXPECT_EQ(tree.sum(0, top), 0);
+
+        // a bounded tree behaves like the dense one
+        SparseFenwickTree<int> small(1000);
+        FenwickTree<int> dense(1000);
+        small.reserve(100);
+        for (int step = 0; step < 2000; ++step) {
+            int index = static_cast<int>(gen() % 1000), delta = static_cast<int>(gen() % 100);
+            small.inc(index, delta);
+            dense.inc(index, delta);
+            int left = static_cast<int>(gen() % 1000), right = static_cast<int>(gen() % 1000);
+            EXPECT_EQ(small.sum(left, right), dense.sum(left, right));
+        }
+    }
+
+    template <typename Tree, typename Combine, typename Apply>
+    void CompareSegmentTree(Tree& tree, std::vector<long long>& values, Combine combine, Apply apply_tag, std::mt19937& gen) {
+        for (int step = 0; step < 3000; ++step) {
+            size_t left = gen() % values.size(), right = gen() % values.size();
+            if (left > right) {
+                std::swap(left, right);
+            }
+            long long tag = static_cast<long long>(gen() % 201) - 100;
+            switch (gen() % 4) {
+                case 0:
+                    tree.apply(left, right, tag);
+                    for (size_t i = left; i <= right; ++i) {
+                        values[i] = apply_tag(values[i], tag);
+                    }
+                    break;
+                case 1:
+                    tree.set(left, tag);
+                    values[left] = tag;
+                    break;
+                default: {
+                    long long expected = values[left];
+                    for (size_t i = left + 1; i <= right; ++i) {
+                        expected = combine(expected, values[i]);
+                    }
+                    EXPECT_EQ(tree.query(right, left), expected);
+                    EXPECT_EQ(tree[right], values[right]);
+                }
+            }
+        }
+    }
+
+    TEST(SegmentTree, LazyOperations) {
+        std::mt19937 gen(49);
+        std::vector<long long> initial(300);
+        for (auto& value : initial) {
+            value = static_cast<long long>(gen() % 1000);
+        }
+        auto add = [](long long value, long long tag) { return value + tag; };
+        auto assign = [](long long, long long tag) { return tag; };
+        auto sum = [](long long lhs, long long rhs) { return lhs + rhs; };
+        auto min = [](long long lhs, long long rhs) { return std::min(lhs, rhs); };
+        auto max = [](long long lhs, long long rhs) { return std::max(lhs, rhs); };
+
+        {
+            SegmentTree<long long> tree(initial);
+            auto values = initial;
+            CompareSegmentTree(tree, values, sum, add, gen);
+        }
+        {
+            SegmentTree<long long, FenwickMin<long long>> tree(initial);
+            auto values = initial;
+            CompareSegmentTree(tree, values, min, add, gen);
+        }
+        {
+            SegmentTree<long long, FenwickSum<long long>, SegmentAssign<long long>> tree(initial);
+            auto values = initial;
+            CompareSegmentTree(tree, values, sum, assign, gen);
+        }
+        {
+            SegmentTree<long long, FenwickMax<long long>, SegmentAssign<long long>> tree(initial.size(), 7);
+            std::vector<long long> values(initial.size(), 7);
+            CompareSegmentTree(tree, values, max, assign, gen);
+        }
+
+        SegmentTree<int> empty(0);
+        EXPECT_EQ(empty.max_right(0, [](int) { return true; }), 0u);
+        EXPECT_THROW(empty.query(0, 0), std::range_error);
+        SegmentTree<int> single(1, 5);
+        EXPECT_EQ(single.query(0, 0), 5);
+        EXPECT_THROW(single.apply(0, 1, 1), std::range_error);
+    }
+
+    TEST(SegmentTree, MaxRight) {
+        std::mt19937 gen(50);
+        for (size_t size : {1u, 5u, 64u, 100u}) {
+            std::vector<int> values(size);
+            for (auto& value : values) {
+                value = static_cast<int>(gen() % 10);
+            }
+            SegmentTree<int> tree(values);
+            for (int step = 0; step < 500; ++step) {
+                size_t left = gen() % size, right = gen() % size;
+                int delta = static_cast<int>(gen() % 5);
+                tree.apply(left, right, delta);
+                for (size_t i = std::min(left, right); i <= std::max(left, right); ++i) {
+                    values[i] += delta;
+                }
+
+                // first right where the running sum from start exceeds the limit
+                size_t start = gen() % (size + 1);
+                int limit = static_cast<int>(gen() % 200);
+                size_t expected = start;
+                for (int running = 0; expected < size && running + values[expected] <= limit; ++expected) {
+                    running += values[expected];
+                }
+                EXPECT_EQ(tree.max_right(start, [limit](int total) { return total <= limit; }), expected);
+            }
+        }
+    }
+
+    TEST(CartesianTree, RangeMinimumQueries) {
+        std::mt19937 gen(50);
+        for (size_t size : {0u, 1u, 63u, 64u, 65u, 200u, 3000u}) {
+            std::vector<int> values(size);
+            for (auto& value : values) {
+                // few distinct values, so ties are common
+                value = static_cast<int>(gen() % 20);
+            }
+            CartesianTree<int> minima(values);
+            CartesianTree<int, std::greater<int>> maxima(values);
+            ASSERT_EQ(minima.size(), size);
+
+            for (int query = 0; size > 0 && query < 2000; ++query) {
+                size_t left = gen() % size, right = gen() % size;
+                if (query % 10 == 0) {
+                    right = std::min(size - 1, left + gen() % 130);
+                }
+                auto first = values.begin() + std::min(left, right), last = values.begin() + std::max(left, right) + 1;
+                size_t expected_min = std::min_element(first, last) - values.begin();
+                size_t expected_max = std::max_element(first, last) - values.begin();
+                EXPECT_EQ(minima.query_index(left, right), expected_min);
+                EXPECT_EQ(maxima.query_index(right, left), expected_max);
+                EXPECT_EQ(minima.query(left, right), values[expected_min]);
+            }
+
+            // heap order on values, in-order traversal gives the indices back
+            if (size == 0) {
+                EXPECT_EQ(minima.root(), CartesianTree<int>::npos);
+                continue;
+            }
+            EXPECT_EQ(minima.root(), minima.query_index(0, size - 1));
+            std::vector<uint32_t> order, stack;
+            for (uint32_t node = minima.root(); node != CartesianTree<int>::npos || !stack.empty();) {
+                if (node != CartesianTree<int>::npos) {
+                    stack.push_back(node);
+                    node = minima.left(node);
+                    continue;
+                }
+                node = stack.back();
+                stack.pop_back();
+                order.push_back(node);
+                if (minima.parent(node) != CartesianTree<int>::npos) {
+                    EXPECT_LE(values[minima.parent(node)], values[node]);
+                }
+                node = minima.right(node);
+            }
+            ASSERT_EQ(order.size(), size);
+            for (size_t i = 0; i < size; ++i) {
+                EXPECT_EQ(order[i], i);
+            }
+        }
+        CartesianTree<int> tree(std::vector<int>{3, 1, 2});
+        EXPECT_THROW(tree.query(0, 3), std::range_error);
+        EXPECT_EQ(tree[2], 2);
+    }
+
+    TEST(MappedFenwickTree, ReopenAndValidate) {
+        std::string path = testing::TempDir() + "mapped_fenwick_tree_test.bin";
+        std::vector<long long> values(500);
+        for (auto& value : values) {
+            value = rand() % 1000;
+        }
+
+        {
+            MappedFenwickTree<long long> tree(path, values);
+            tree.inc(17, 3);
+            tree.set(400, -5);
+            tree.sync();
+        }
+        values[17] += 3;
+        values[400] = -5;
+
+        {
+            MappedFenwickTree<long long> tree(path);
+            ASSERT_EQ(tree.size(), values.size());
+            for (size_t i = 0; i < values.size(); ++i) {
+                EXPECT_EQ(tree[i], values[i]);
+            }
+            EXPECT_EQ(tree.sum(0, 499), std::accumulate(values.begin(), values.end(), 0LL));
+            EXPECT_EQ(tree.sum(10, 20), std::accumulate(values.begin() + 10, values.begin() + 21, 0LL));
+        }
+
+        EXPECT_THROW(MappedFenwickTree<int>{path}, std::runtime_error);
+        EXPECT_THROW(MappedFenwickTree<double>{path}, std::runtime_error);
+
+        {
+            MappedFenwickTree<int> tree(path, 10);
+            EXPECT_EQ(tree.sum(0, 9), 0);
+        }
+        std::remove(path.c_str());
+    }
 }
@@ -0,0 +1,492 @@
+#pragma once
+
+#include <memory>
+#include <iostream>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Treap node owned by a single unique_ptr: no reference counting and no parent links,
+// so a node is three words smaller than Node and Split/Merge never touch atomics.
+// It offers the same Split/Merge/Insert/Erase/GetByIndex/DeepCopy/Build/VisitInOrder
+// functions as nodes.hpp, but not the parent based navigation (GetNext, GetPrev, ...).
+template <typename ValueT, typename PriorityT>
+class UniqueNode;
+
+template <typename ValueT, typename PriorityT>
+using unique_nodeptr_t = std::unique_ptr<UniqueNode<ValueT, PriorityT>>;
+
+template <typename ValueT, typename PriorityT>
+class UniqueNode {
+private:
+    ValueT value_;
+    PriorityT priority_;
+    unsigned subtree_size_;
+
+    unique_nodeptr_t<ValueT, PriorityT> left_;
+    unique_nodeptr_t<ValueT, PriorityT> right_;
+
+public:
+    using value_type = ValueT;
+    using priority_type = PriorityT;
+
+    UniqueNode(const ValueT& value, const PriorityT& priority)
+            : value_(value), priority_(priority), subtree_size_(1), left_(nullptr), right_(nullptr) {
+    }
+
+    // Iterative teardown, as ~Node in nodes.hpp
+    ~UniqueNode() {
+        std::vector<unique_nodeptr_t<ValueT, PriorityT>> pending;
+        TakeChildren(pending);
+        while (!pending.empty()) {
+            auto node = std::move(pending.back());
+            pending.pop_back();
+            node->TakeChildren(pending);
+        }
+    }
+
+    void TakeChildren(std::vector<unique_nodeptr_t<ValueT, PriorityT>>& pending) {
+        if (left_ != nullptr) {
+            pending.push_back(std::move(left_));
+        }
+        if (right_ != nullptr) {
+            pending.push_back(std::move(right_));
+        }
+    }
+
+    const ValueT& GetValue() const {
+        return value_;
+    }
+
+    ValueT& GetValue() {
+        return value_;
+    }
+
+    const PriorityT& GetPriority() const {
+        return priority_;
+    }
+
+    unsigned GetSubtreeSize() const {
+        return subtree_size_;
+    }
+
+    const unique_nodeptr_t<ValueT, PriorityT>& GetLeft() const {
+        return left_;
+    }
+
+    const unique_nodeptr_t<ValueT, PriorityT>& GetRight() const {
+        return right_;
+    }
+
+    unique_nodeptr_t<ValueT, PriorityT> ReleaseLeft() {
+        return std::move(left_);
+    }
+
+    unique_nodeptr_t<ValueT, PriorityT> ReleaseRight() {
+        return std::move(right_);
+    }
+
+    void SetLeft(unique_nodeptr_t<ValueT, PriorityT> left) {
+        left_ = std::move(left);
+        Update();
+    }
+
+    void SetRight(unique_nodeptr_t<ValueT, PriorityT> right) {
+        right_ = std::move(right);
+        Update();
+    }
+
+    void Update() {
+        subtree_size_ = 1;
+        if (left_ != nullptr) {
+            subtree_size_ += left_->GetSubtreeSize();
+        }
+        if (right_ != nullptr) {
+            subtree_size_ += right_->GetSubtreeSize();
+        }
+    }
+};
+
+template <typename ValueT, typename PriorityT>
+unique_nodeptr_t<ValueT, PriorityT>
+MakeUniqueNodePtrT(const ValueT& value, const PriorityT& priority) {
+    return std::make_unique<UniqueNode<ValueT, PriorityT>>(value, priority);
+}
+
+template <typename ValueT, typename PriorityT>
+std::ostream& operator<<(std::ostream& output_stream, const UniqueNode<ValueT, PriorityT>& node) {
+    output_stream << "size: " << node.GetSubtreeSize() << ", value: " << node.GetValue()
+                  << ", priority: " << node.GetPriority();
+    return output_stream;
+}
+
+
+
+template <typename ValueT, typename PriorityT>
+std::tuple<unique_nodeptr_t<ValueT, PriorityT>, unique_nodeptr_t<ValueT, PriorityT>>
+Split(unique_nodeptr_t<ValueT, PriorityT> node, unsigned index) {
+    if (node == nullptr) {
+        return std::make_tuple(nullptr, nullptr);
+    } else {
+        unsigned elements_before = 0;
+        if (node->GetLeft() != nullptr) {
+            elements_before = node->GetLeft()->GetSubtreeSize();
+        }
+        if (elements_before >= index) {
+            auto [split_first, split_second] = Split(node->ReleaseLeft(), index);
+            node->SetLeft(std::move(split_second));
+            return std::make_tuple(std::move(split_first), std::move(node));
+        } else {
+            auto [split_first, split_second] = Split(node->ReleaseRight(), index - elements_before - 1);
+            node->SetRight(std::move(split_first));
+            return std::make_tuple(std::move(node), std::move(split_second));
+        }
+    }
+}
+
+template <typename ValueT, typename PriorityT, typename ... Args>
+decltype(auto)
+Split(unique_nodeptr_t<ValueT, PriorityT> node, unsigned index, Args ... args) {
+    auto [split_left, split_right] = Split(std::move(node), index);
+    return std::tuple_cat(std::make_tuple(std::move(split_left)), Split(std::move(split_right), args ...));
+}
+
+
+
+template <typename ValueT, typename PriorityT>
+unique_nodeptr_t<ValueT, PriorityT>
+Merge(unique_nodeptr_t<ValueT, PriorityT> left, unique_nodeptr_t<ValueT, PriorityT> right) {
+    if (left == nullptr) {
+        return right;
+    } else if (right == nullptr) {
+        return left;
+    } else if (left->GetPriority() > right->GetPriority()) {
+        left->SetRight(Merge(left->ReleaseRight(), std::move(right)));
+        return left;
+    } else {
+        right->SetLeft(Merge(std::move(left), right->ReleaseLeft()));
+        return right;
+    }
+}
+
+template <typename ValueT, typename PriorityT, typename... OtherT>
+unique_nodeptr_t<ValueT, PriorityT>
+Merge(unique_nodeptr_t<ValueT, PriorityT> node, OtherT... other) {
+    return Merge(std::move(node), Merge(std::move(other)...));
+}
+
+
+template <typename ValueT, typename PriorityT>
+unique_nodeptr_t<ValueT, PriorityT>
+Insert(unique_nodeptr_t<ValueT, PriorityT> node,
+       unsigned position,
+       const typename unique_nodeptr_t<ValueT, PriorityT>::element_type::value_type& value,
+       const typename unique_nodeptr_t<ValueT, PriorityT>::element_type::priority_type& priority) {
+    if (node == nullptr) {
+        return MakeUniqueNodePtrT<ValueT, PriorityT>(value, priority);
+    } else if (node->GetPriority() < priority) {
+        auto [split_left, split_right] = Split(std::move(node), position);
+        auto new_node = MakeUniqueNodePtrT<ValueT, PriorityT>(value, priority);
+        return Merge(std::move(split_left), Merge(std::move(new_node), std::move(split_right)));
+    } else {
+        unsigned elements_before = 0;
+        if (node->GetLeft() != nullptr) {
+            elements_before = node->GetLeft()->GetSubtreeSize();
+        }
+        if (position <= elements_before) {
+            node->SetLeft(Insert(node->ReleaseLeft(), position, value, priority));
+        } else {
+            node->SetRight(Insert(node->ReleaseRight(), position - 1 - elements_before, value, priority));
+        }
+        return node;
+    }
+}
+
+
+
+template <typename ValueT, typename PriorityT>
+unique_nodeptr_t<ValueT, PriorityT>
+Erase(unique_nodeptr_t<ValueT, PriorityT> node, unsigned position) {
+    if (node == nullptr) {
+        return nullptr;
+    }
+
+    unsigned elements_before = 0;
+    if (node->GetLeft() != nullptr) {
+        elements_before = node->GetLeft()->GetSubtreeSize();
+    }
+
+    if (position == elements_before) {
+        return Merge(node->ReleaseLeft(), node->ReleaseRight());
+    } else if (elements_before > position) {
+        node->SetLeft(Erase(node->ReleaseLeft(), position));
+    } else {
+        node->SetRight(Erase(node->ReleaseRight(), position - elements_before - 1));
+    }
+    return node;
+}
+
+
+template <typename ValueT, typename PriorityT>
+void
+SplitMany(unique_nodeptr_t<ValueT, PriorityT> node, const unsigned* cuts_begin, const unsigned* cuts_end,
+          unsigned offset, std::vector<unique_nodeptr_t<ValueT, PriorityT>>& pieces) {
+    if (cuts_begin == cuts_end) {
+        pieces.push_back(std::move(node));
+        return;
+    } else if (node == nullptr) {
+        for (const unsigned* cut = cuts_begin; cut <= cuts_end; ++cut) {
+            pieces.push_back(nullptr);
+        }
+        return;
+    }
+
+    unsigned position = offset;
+    if (node->GetLeft() != nullptr) {
+        position += node->GetLeft()->GetSubtreeSize();
+    }
+    const unsigned* cuts_middle = cuts_begin;
+    while (cuts_middle != cuts_end && *cuts_middle <= position) {
+        ++cuts_middle;
+    }
+
+    SplitMany(node->ReleaseLeft(), cuts_begin, cuts_middle, offset, pieces);
+    auto left_tail = std::move(pieces.back());
+    pieces.pop_back();
+    size_t right_head_index = pieces.size();
+    SplitMany(node->ReleaseRight(), cuts_middle, cuts_end, position + 1, pieces);
+
+    node->SetLeft(std::move(left_tail));
+    node->SetRight(std::move(pieces[right_head_index]));
+    pieces[right_head_index] = std::move(node);
+}
+
+// Splits at sorted positions in one descent, as SplitMany in nodes.hpp
+template <typename ValueT, typename PriorityT>
+std::vector<unique_nodeptr_t<ValueT, PriorityT>>
+SplitMany(unique_nodeptr_t<ValueT, PriorityT> node, const std::vector<unsigned>& cuts) {
+    std::vector<unique_nodeptr_t<ValueT, PriorityT>> pieces;
+    pieces.reserve(cuts.size() + 1);
+    SplitMany(std::move(node), cuts.data(), cuts.data() + cuts.size(), 0, pieces);
+    return pieces;
+}
+
+// Pairwise merge rounds, as MergeMany in nodes.hpp
+template <typename ValueT, typename PriorityT>
+unique_nodeptr_t<ValueT, PriorityT>
+MergeMany(std::vector<unique_nodeptr_t<ValueT, PriorityT>> pieces) {
+    if (pieces.empty()) {
+        return nullptr;
+    }
+    while (pieces.size() > 1) {
+        size_t merged = 0;
+        for (size_t i = 0; i < pieces.size(); i += 2) {
+            if (i + 1 < pieces.size()) {
+                pieces[merged++] = Merge(std::move(pieces[i]), std::move(pieces[i + 1]));
+            } else {
+                pieces[merged++] = std::move(pieces[i]);
+            }
+        }
+        pieces.resize(merged);
+    }
+    return std::move(pieces.front());
+}
+
+// Value based split and merge of sorted treaps, as in nodes.hpp
+template <typename ValueT, typename PriorityT, typename Compare>
+std::tuple<unique_nodeptr_t<ValueT, PriorityT>, unique_nodeptr_t<ValueT, PriorityT>>
+SplitByValue(unique_nodeptr_t<ValueT, PriorityT> node, const ValueT& value, Compare comp, bool or_equal) {
+    if (node == nullptr) {
+        return std::make_tuple(nullptr, nullptr);
+    }
+    bool goes_first = or_equal ? !comp(value, node->GetValue()) : comp(node->GetValue(), value);
+    if (goes_first) {
+        auto [split_first, split_second] = SplitByValue(node->ReleaseRight(), value, comp, or_equal);
+        node->SetRight(std::move(split_first));
+        return std::make_tuple(std::move(node), std::move(split_second));
+    } else {
+        auto [split_first, split_second] = SplitByValue(node->ReleaseLeft(), value, comp, or_equal);
+        node->SetLeft(std::move(split_second));
+        return std::make_tuple(std::move(split_first), std::move(node));
+    }
+}
+
+template <typename ValueT, typename PriorityT, typename Compare>
+unique_nodeptr_t<ValueT, PriorityT>
+MergeSorted(unique_nodeptr_t<ValueT, PriorityT> first, unique_nodeptr_t<ValueT, PriorityT> second, Compare comp) {
+    if (first == nullptr) {
+        return second;
+    } else if (second == nullptr) {
+        return first;
+    } else if (first->GetPriority() >= second->GetPriority()) {
+        auto [split_first, split_second] = SplitByValue(std::move(second), first->GetValue(), comp, false);
+        first->SetLeft(MergeSorted(first->ReleaseLeft(), std::move(split_first), comp));
+        first->SetRight(MergeSorted(first->ReleaseRight(), std::move(split_second), comp));
+        return first;
+    } else {
+        auto [split_first, split_second] = SplitByValue(std::move(first), second->GetValue(), comp, true);
+        second->SetLeft(MergeSorted(std::move(split_first), second->ReleaseLeft(), comp));
+        second->SetRight(MergeSorted(std::move(split_second), second->ReleaseRight(), comp));
+        return second;
+    }
+}
+
+// Sorted mode descents, as CountByValue and InsertByValue in nodes.hpp
+template <typename ValueT, typename PriorityT, typename Compare>
+unsigned
+CountByValue(const unique_nodeptr_t<ValueT, PriorityT>& node, const ValueT& value, Compare comp, bool or_equal) {
+    unsigned count = 0;
+    const UniqueNode<ValueT, PriorityT>* iter = node.get();
+    while (iter != nullptr) {
+        bool goes_first = or_equal ? !comp(value, iter->GetValue()) : comp(iter->GetValue(), value);
+        if (goes_first) {
+            count += 1;
+            if (iter->GetLeft() != nullptr) {
+                count += iter->GetLeft()->GetSubtreeSize();
+            }
+            iter = iter->GetRight().get();
+        } else {
+            iter = iter->GetLeft().get();
+        }
+    }
+    return count;
+}
+
+template <typename ValueT, typename PriorityT, typename Compare>
+unique_nodeptr_t<ValueT, PriorityT>
+InsertByValue(unique_nodeptr_t<ValueT, PriorityT> node, const ValueT& value, const PriorityT& priority,
+              Compare comp, unsigned& position) {
+    if (node == nullptr) {
+        return MakeUniqueNodePtrT<ValueT, PriorityT>(value, priority);
+    } else if (node->GetPriority() < priority) {
+        auto [split_left, split_right] = SplitByValue(std::move(node), value, comp, true);
+        if (split_left != nullptr) {
+            position += split_left->GetSubtreeSize();
+        }
+        auto new_node = MakeUniqueNodePtrT<ValueT, PriorityT>(value, priority);
+        new_node->SetLeft(std::move(split_left));
+        new_node->SetRight(std::move(split_right));
+        return new_node;
+    } else if (!comp(value, node->GetValue())) {
+        position += 1;
+        if (node->GetLeft() != nullptr) {
+            position += node->GetLeft()->GetSubtreeSize();
+        }
+        node->SetRight(InsertByValue(node->ReleaseRight(), value, priority, comp, position));
+    } else {
+        node->SetLeft(InsertByValue(node->ReleaseLeft(), value, priority, comp, position));
+    }
+    return node;
+}
+
+// Links nodes given in order into a treap in O(n), nodes must have no children
+template <typename ValueT, typename PriorityT>
+unique_nodeptr_t<ValueT, PriorityT>
+Build(std::vector<unique_nodeptr_t<ValueT, PriorityT>> nodes) {
+    // right spine of the tree built so far, a node is complete when it leaves the spine
+    std::vector<unique_nodeptr_t<ValueT, PriorityT>> spine;
+    for (auto& node : nodes) {
+        unique_nodeptr_t<ValueT, PriorityT> last = nullptr;
+        while (!spine.empty() && spine.back()->GetPriority() < node->GetPriority()) {
+            unique_nodeptr_t<ValueT, PriorityT> popped = std::move(spine.back());
+            spine.pop_back();
+            if (last != nullptr) {
+                popped->SetRight(std::move(last));
+            }
+            last = std::move(popped);
+        }
+        node->SetLeft(std::move(last));
+        spine.push_back(std::move(node));
+    }
+
+    unique_nodeptr_t<ValueT, PriorityT> root = nullptr;
+    while (!spine.empty()) {
+        unique_nodeptr_t<ValueT, PriorityT> popped = std::move(spine.back());
+        spine.pop_back();
+        if (root != nullptr) {
+            popped->SetRight(std::move(root));
+        }
+        root = std::move(popped);
+    }
+    return root;
+}
+
+template <typename ValueT, typename PriorityT, typename Visitor>
+void
+VisitInOrder(const unique_nodeptr_t<ValueT, PriorityT>& node, Visitor visitor) {
+    std::vector<UniqueNode<ValueT, PriorityT>*> path;
+    UniqueNode<ValueT, PriorityT>* iter = node.get();
+    while (iter != nullptr || !path.empty()) {
+        while (iter != nullptr) {
+            path.push_back(iter);
+            iter = iter->GetLeft().get();
+        }
+        iter = path.back();
+        path.pop_back();
+        visitor(*iter);
+        iter = iter->GetRight().get();
+    }
+}
+
+template <typename ValueT, typename PriorityT>
+UniqueNode<ValueT, PriorityT>*
+GetByIndex(const unique_nodeptr_t<ValueT, PriorityT>& node, unsigned index) {
+    UniqueNode<ValueT, PriorityT>* iter = node.get();
+    while (iter != nullptr) {
+        unsigned elements_before = 0;
+        if (iter->GetLeft() != nullptr) {
+            elements_before = iter->GetLeft()->GetSubtreeSize();
+        }
+        if (elements_before == index) {
+            return iter;
+        } else if (elements_before > index) {
+            iter = iter->GetLeft().get();
+        } else {
+            index -= elements_before + 1;
+            iter = iter->GetRight().get();
+        }
+    }
+    return nullptr;
+}
+
+template <typename ValueT, typename PriorityT>
+unique_nodeptr_t<ValueT, PriorityT>
+DeepCopy(const unique_nodeptr_t<ValueT, PriorityT>& node) {
+    if (node == nullptr) {
+        return nullptr;
+    } else {
+        auto new_node = MakeUniqueNodePtrT<ValueT, PriorityT>(node->GetValue(), node->GetPriority());
+        new_node->SetLeft(DeepCopy(node->GetLeft()));
+        new_node->SetRight(DeepCopy(node->GetRight()));
+        return new_node;
+    }
+}
+
+template <typename ValueT, typename PriorityT>
+void
+Dump(const unique_nodeptr_t<ValueT, PriorityT>& node, unsigned offset = 0) {
+    if (node != nullptr) {
+        Dump(node->GetLeft(), offset + 1);
+        for (size_t i = 0; i < offset; ++i) {
+            std::cout << "  ";
+        }
+        std::cout << *node << std::endl;
+        Dump(node->GetRight(), offset + 1);
+    }
+    if (offset == 0) {
+        std::cout << "-------------------------------------------" << std::endl;
+    }
+}
+
+// Storage policy of AdvancedVector for uniquely owned nodes, see SharedNodeStorage in nodes.hpp
+struct UniqueNodeStorage {
+    template <typename ValueT, typename PriorityT>
+    using pointer = unique_nodeptr_t<ValueT, PriorityT>;
+
+    static constexpr bool kHasParentLinks = false;
+
+    template <typename ValueT, typename PriorityT>
+    static pointer<ValueT, PriorityT> MakeNode(const ValueT& value, const PriorityT& priority) {
+        return MakeUniqueNodePtrT<ValueT, PriorityT>(value, priority);
+    }
+};